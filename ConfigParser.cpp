@@ -37,6 +37,7 @@ using std::string;
 
 typedef std::map<string,uint64_t> IntMap; ///< key/value pairs for integer parameters
 typedef std::map<string,Network_t> NetworkMap; ///< key/value pairs for network parameters
+typedef std::map<string,string> StringMap; ///< key/value pairs for text parameters
 
 /**
  * Config parser internal kitchen class
@@ -49,6 +50,7 @@ class ConfigParser::Data{
 		/* Data members (public) */
 		IntMap intmap; ///< key/value pairs for integer parameters
 		NetworkMap networkmap; ///< key/value pairs for network parameters
+		StringMap stringmap; ///< key/value pairs for text parameters
 	private:
 		bool addKeyNetworkValue(string key, string value, u32 linenr); 
 };
@@ -100,6 +102,7 @@ void ConfigParser::Data::clear()
 {
 	intmap.clear();
 	networkmap.clear();
+	stringmap.clear();
 }
 
 /**
@@ -112,12 +115,22 @@ void ConfigParser::Data::clear()
 
 bool ConfigParser::Data::addKeyValue(string key, string value, u32 linenr)
 {
-	if((key=="FixedPrefix") || (key=="InitialNetwork") || (key=="Postfix"))
+	if((key=="FixedPrefix") || (key=="InitialNetwork") || (key=="Postfix") || (key=="VerifyNetwork"))
 	{
 		/* For these two keys, delegate further processing to network value handler */
 		return addKeyNetworkValue(key,value,linenr);
 	}
 	
+	if(key=="ControlSocket")
+	{
+		if(!stringmap.insert(std::pair<string,string>(key,value)).second)
+		{
+			printf("Duplicate key '%s' in config file, line %u\n",key.c_str(),linenr);
+			return false;
+		}
+		return true;
+	}
+	
 	if(intmap.find(key)!=intmap.end())
 	{
 		printf("Duplicate key '%s' in config file, line %u\n",key.c_str(),linenr);
@@ -244,7 +257,7 @@ bool ConfigParser::Data::verifyNumKey(string key, uint64_t minval, uint64_t maxv
 	return true;
 }
 
-bool ConfigParser::parseConfig(const char *filename)
+bool ConfigParser::parseConfig(const char *filename, bool searchkeys)
 {
 	data->clear();
 	std::ifstream infile(filename);
@@ -285,8 +298,11 @@ bool ConfigParser::parseConfig(const char *filename)
     infile.close();
     
     /* Limits of mandatory numeric keys*/
-    fileok = fileok && data->verifyNumKey("Ninputs",2,NMAX);
-    fileok = fileok && data->verifyNumKey("Symmetric",0,1);
+    if(searchkeys)
+    {
+        fileok = fileok && data->verifyNumKey("Ninputs",2,NMAX);
+        fileok = fileok && data->verifyNumKey("Symmetric",0,1);
+    }
 	
 	return fileok;
 }
@@ -320,6 +336,30 @@ const Network_t &ConfigParser::getNetwork(string key) const
 }
 
 
+string ConfigParser::getString(string key, string defaultval) const
+{
+	StringMap::const_iterator it=data->stringmap.find(key);
+	if(it==data->stringmap.end())
+	{
+		return defaultval;
+	}
+	else
+	{
+		return it->second;
+	}
+}
+
+bool ConfigParser::parseSetting(const string &line)
+{
+	string l=stripline(line);
+	size_t klen=l.find('=');
+	if((klen==string::npos) || (klen<1u))
+	{
+		return false;
+	}
+	return data->addKeyValue(stripline(l.substr(0,klen)),stripline(l.substr(klen+1)),1);
+}
+
 ConfigParser::ConfigParser()
 {
 	data=new Data; // Data default constructor starts with empty databases (ok)
@@ -46,9 +46,10 @@ class ConfigParser
 		/**
 		 * Reads a config file into the object structures
 		 * @param filename Name of config file. Will be opened for reading only.
+		 * @param searchkeys Check presence and range of the keys a search needs (Ninputs, Symmetric)
 		 * @return true if config file was successfully read
 		 */
-		bool parseConfig(const char *filename);
+		bool parseConfig(const char *filename, bool searchkeys=true);
 		
 		/**
 		 * Reads an integer parameter from the config file
@@ -67,6 +68,23 @@ class ConfigParser
 		 */
 		const Network_t &getNetwork(std::string key) const;
 		
+		/**
+		 * Reads a text parameter from the config file
+		 * If the parameter was not specified, the default is used
+		 * @param key Parameter name
+		 * @param defaultval Default value if parameter was not found
+		 * @return Parameter value
+		 */
+		std::string getString(std::string key, std::string defaultval="") const;
+		
+		/**
+		 * Reads a single "key=value" line as found in a config file, e.g. a setting changed over the control socket.
+		 * Mandatory keys are not checked.
+		 * @param line Text of the line
+		 * @return true if the line was successfully read
+		 */
+		bool parseSetting(const std::string &line);
+		
 		/**
 		 * Clean up
 		 */
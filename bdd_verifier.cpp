@@ -0,0 +1,345 @@
+/**
+ * @file bdd_verifier.cpp
+ * @brief Sortedness verifier based on reduced ordered binary decision diagrams
+ * @author Bert Dobbelaere bert.o.dobbelaere[at]telenet[dot]be
+ *
+ * Copyright (c) 2022 Bert Dobbelaere
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "bdd_verifier.h"
+#include <unordered_map>
+#include <algorithm>
+
+#define BDD_FALSE (0u)          ///< Terminal node 0
+#define BDD_TRUE (1u)           ///< Terminal node 1
+#define BDD_CACHEBITS (20)      ///< log2 of the number of entries in the computed table
+#define BDD_MAXNODES (1u<<28)   ///< Node indices must fit in 28 bits to form unique table keys
+#define BDD_FIRSTCOMPACT (1u<<16) ///< Node count that triggers the first compaction
+
+/**
+ * Binary operations on BDDs
+ */
+enum BDDOp_t {
+	BDD_AND,    ///< a & b
+	BDD_OR,     ///< a | b
+	BDD_ANDNOT  ///< a & ~b
+};
+
+/**
+ * Minimal reduced ordered BDD package. Nodes are identified by their index, variable order is the input index.
+ * There is no reference counting: dead nodes are removed by compact(), which keeps only the nodes reachable from a set of roots.
+ */
+class BDDManager {
+public:
+	BDDManager(u8 nvars, u32 maxnodes);
+	u32 variable(u8 v);
+	u32 apply(BDDOp_t op, u32 a, u32 b);
+	SortWord_t satisfyingInput(u32 f) const;
+	void compact(std::vector<u32> &roots);
+	size_t size() const { return nodes.size();} ///< Number of nodes, including dead ones
+	bool overflow() const { return overflowed;} ///< Node limit was hit, results are no longer valid
+private:
+	struct Node_t {
+		u32 var;     ///< Variable index, nvars for the terminal nodes
+		u32 lo,hi;   ///< Successor nodes for variable value 0 and 1
+	};
+	
+	struct CacheEntry_t {
+		u32 a,b,op,result;
+	};
+	
+	u32 mk(u32 var, u32 lo, u32 hi);
+	u32 copyNode(const std::vector<Node_t> &old, u32 f, std::vector<u32> &remap);
+	void clearCache();
+	static uint64_t nodeKey(u32 var, u32 lo, u32 hi) { return ((uint64_t)var<<56)|((uint64_t)lo<<28)|hi;}
+	
+	u32 nvars;
+	u32 limit;
+	bool overflowed;
+	std::vector<Node_t> nodes;
+	std::unordered_map<uint64_t,u32> unique;
+	std::vector<CacheEntry_t> cache;
+};
+
+/**
+ * Create a BDD manager holding only the terminal nodes
+ * @param nvars Number of variables
+ * @param maxnodes Maximum number of nodes
+ */
+BDDManager::BDDManager(u8 nvars, u32 maxnodes):nvars(nvars),limit(std::min(maxnodes,BDD_MAXNODES)),overflowed(false)
+{
+	nodes.push_back({nvars,BDD_FALSE,BDD_FALSE});
+	nodes.push_back({nvars,BDD_TRUE,BDD_TRUE});
+	cache.resize(1u<<BDD_CACHEBITS);
+	clearCache();
+}
+
+/**
+ * Invalidate all entries of the computed table
+ */
+void BDDManager::clearCache()
+{
+	for(size_t n=0;n<cache.size();n++)
+	{
+		cache[n].op=~0u;
+	}
+}
+
+/**
+ * Find or create the node for a variable with given successors
+ * @param var Variable index
+ * @param lo Successor for variable value 0
+ * @param hi Successor for variable value 1
+ * @return Node index
+ */
+u32 BDDManager::mk(u32 var, u32 lo, u32 hi)
+{
+	if(lo==hi)
+		return lo;
+	
+	uint64_t key=nodeKey(var,lo,hi);
+	auto it=unique.find(key);
+	if(it!=unique.end())
+		return it->second;
+	
+	if(nodes.size()>=limit)
+	{
+		overflowed=true;
+		return BDD_FALSE;
+	}
+	
+	u32 f=nodes.size();
+	nodes.push_back({var,lo,hi});
+	unique[key]=f;
+	return f;
+}
+
+/**
+ * BDD of a single variable
+ * @param v Variable index
+ * @return Node index
+ */
+u32 BDDManager::variable(u8 v)
+{
+	return mk(v,BDD_FALSE,BDD_TRUE);
+}
+
+/**
+ * Apply a binary operation to two BDDs
+ * @param op Operation
+ * @param a First operand
+ * @param b Second operand
+ * @return Node index of the result
+ */
+u32 BDDManager::apply(BDDOp_t op, u32 a, u32 b)
+{
+	switch(op)
+	{
+		case BDD_AND:
+			if((a==BDD_FALSE)||(b==BDD_FALSE)) return BDD_FALSE;
+			if((a==BDD_TRUE)||(a==b)) return b;
+			if(b==BDD_TRUE) return a;
+			if(a>b) std::swap(a,b);
+			break;
+		case BDD_OR:
+			if((a==BDD_TRUE)||(b==BDD_TRUE)) return BDD_TRUE;
+			if((a==BDD_FALSE)||(a==b)) return b;
+			if(b==BDD_FALSE) return a;
+			if(a>b) std::swap(a,b);
+			break;
+		case BDD_ANDNOT:
+			if((a==BDD_FALSE)||(b==BDD_TRUE)||(a==b)) return BDD_FALSE;
+			if(b==BDD_FALSE) return a;
+			break;
+	}
+	
+	size_t slot=((a*0x9E3779B1u)^(b*0x85EBCA77u)^op)&((1u<<BDD_CACHEBITS)-1);
+	if((cache[slot].a==a)&&(cache[slot].b==b)&&(cache[slot].op==(u32)op))
+		return cache[slot].result;
+	
+	// Nodes may be reallocated by the recursive calls: copy what is needed first
+	u32 va=nodes[a].var, vb=nodes[b].var;
+	u32 v=std::min(va,vb);
+	u32 a0=(va==v)?nodes[a].lo:a, a1=(va==v)?nodes[a].hi:a;
+	u32 b0=(vb==v)?nodes[b].lo:b, b1=(vb==v)?nodes[b].hi:b;
+	
+	u32 r0=apply(op,a0,b0);
+	u32 r1=apply(op,a1,b1);
+	u32 r=mk(v,r0,r1);
+	
+	cache[slot]={a,b,(u32)op,r};
+	return r;
+}
+
+/**
+ * Find an input for which a function evaluates to 1
+ * @param f BDD of the function, not BDD_FALSE
+ * @return Input pattern, variables that don't matter are 0
+ */
+SortWord_t BDDManager::satisfyingInput(u32 f) const
+{
+	SortWord_t input=0;
+	while(f>BDD_TRUE)
+	{
+		// In a reduced BDD, every non-terminal node leads to BDD_TRUE
+		if(nodes[f].hi!=BDD_FALSE)
+		{
+			input|=1ULL<<nodes[f].var;
+			f=nodes[f].hi;
+		}
+		else
+		{
+			f=nodes[f].lo;
+		}
+	}
+	return input;
+}
+
+/**
+ * Copy a node and its successors into the node table
+ * @param old Previous node table
+ * @param f Index of the node in the previous table
+ * @param remap [IN/OUT] New index of nodes of the previous table that were copied already, 0 otherwise
+ * @return New node index
+ */
+u32 BDDManager::copyNode(const std::vector<Node_t> &old, u32 f, std::vector<u32> &remap)
+{
+	if(f<=BDD_TRUE)
+		return f;
+	if(remap[f]==0)
+	{
+		u32 lo=copyNode(old,old[f].lo,remap);
+		u32 hi=copyNode(old,old[f].hi,remap);
+		remap[f]=mk(old[f].var,lo,hi);
+	}
+	return remap[f];
+}
+
+/**
+ * Remove all nodes that are not reachable from a set of roots
+ * @param roots [IN/OUT] Root nodes, updated to their new index
+ */
+void BDDManager::compact(std::vector<u32> &roots)
+{
+	std::vector<Node_t> old;
+	old.swap(nodes);
+	std::vector<u32> remap(old.size(),0);
+	
+	unique.clear();
+	nodes.push_back(old[BDD_FALSE]);
+	nodes.push_back(old[BDD_TRUE]);
+	for(size_t n=0;n<roots.size();n++)
+	{
+		roots[n]=copyNode(old,roots[n],remap);
+	}
+	clearCache();
+}
+
+/**
+ * Choose the BDD variable order: inputs are listed in the order in which the network merges them into clusters of connected lines,
+ * so that inputs combined by the first CEs are neighbours. This keeps the BDDs of the intermediate line functions small.
+ * @param ninputs Number of inputs
+ * @param nw Network
+ * @param order [OUT] Input index of each BDD variable
+ */
+static void variableOrder(u8 ninputs, const Network_t &nw, std::vector<u8> &order)
+{
+	std::vector<std::vector<u8> > clusters(ninputs);
+	std::vector<u8> cluster(ninputs);
+	
+	for(u8 k=0;k<ninputs;k++)
+	{
+		clusters[k].push_back(k);
+		cluster[k]=k;
+	}
+	for(size_t n=0;n<nw.size();n++)
+	{
+		u8 a=cluster[nw[n].lo], b=cluster[nw[n].hi];
+		if(a!=b)
+		{
+			for(size_t i=0;i<clusters[b].size();i++)
+			{
+				cluster[clusters[b][i]]=a;
+			}
+			clusters[a].insert(clusters[a].end(),clusters[b].begin(),clusters[b].end());
+			clusters[b].clear();
+		}
+	}
+	
+	order.clear();
+	for(u8 k=0;k<ninputs;k++)
+	{
+		order.insert(order.end(),clusters[k].begin(),clusters[k].end());
+	}
+}
+
+BDDResult_t verifySorterBDD(u8 ninputs, const Network_t &nw, u32 maxnodes, SortWord_t *failed_input)
+{
+	BDDManager bdd(ninputs,maxnodes);
+	std::vector<u32> lines(ninputs);
+	std::vector<u8> order;
+	
+	variableOrder(ninputs,nw,order);
+	for(u8 v=0;v<ninputs;v++)
+	{
+		lines[order[v]]=bdd.variable(v);
+	}
+	
+	size_t threshold=BDD_FIRSTCOMPACT;
+	for(size_t n=0;n<nw.size();n++)
+	{
+		u32 a=lines[nw[n].lo];
+		u32 b=lines[nw[n].hi];
+		lines[nw[n].lo]=bdd.apply(BDD_AND,a,b);
+		lines[nw[n].hi]=bdd.apply(BDD_OR,a,b);
+		
+		if(bdd.size()>threshold)
+		{
+			bdd.compact(lines);
+			threshold=std::max(threshold,2*bdd.size());
+		}
+		if(bdd.overflow())
+			return BDD_TOO_LARGE;
+	}
+	
+	for(u8 k=0;k+1<ninputs;k++)
+	{
+		u32 diff=bdd.apply(BDD_ANDNOT,lines[k],lines[k+1]);
+		if(bdd.overflow())
+			return BDD_TOO_LARGE;
+		if(diff!=BDD_FALSE)
+		{
+			if(failed_input)
+			{
+				SortWord_t assignment=bdd.satisfyingInput(diff);
+				*failed_input=0;
+				for(u8 v=0;v<ninputs;v++)
+				{
+					*failed_input|=((assignment>>v)&1)<<order[v];
+				}
+			}
+			return BDD_NOT_SORTER;
+		}
+	}
+	return BDD_SORTER;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file bdd_verifier.h
+ * @brief Sortedness verifier based on reduced ordered binary decision diagrams
+ * @author Bert Dobbelaere bert.o.dobbelaere[at]telenet[dot]be
+ *
+ * Copyright (c) 2022 Bert Dobbelaere
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BDD_VERIFIER_H_
+#define _BDD_VERIFIER_H_
+
+#include "htypes.h"
+
+/**
+ * Outcome of a BDD verification
+ */
+enum BDDResult_t {
+	BDD_SORTER,     ///< Network sorts all inputs
+	BDD_NOT_SORTER, ///< Network leaves at least one input unsorted
+	BDD_TOO_LARGE   ///< Node limit reached before the verification could complete
+};
+
+/**
+ * Verify a complete network by building the reduced ordered BDD of the boolean function of every line, input by input, and
+ * checking line[k] => line[k+1] for all neighbouring lines. Unlike the bit-parallel tester, memory use does not depend on the
+ * number of possible input patterns, so large networks (N up to NMAX) can be verified without a prefix.
+ * @param ninputs Number of inputs
+ * @param nw Network to verify, including prefix and postfix
+ * @param maxnodes Maximum number of live BDD nodes
+ * @param failed_input [OUT] If not NULL, receives an input pattern that is not sorted when the result is BDD_NOT_SORTER
+ * @return Verification result
+ */
+BDDResult_t verifySorterBDD(u8 ninputs, const Network_t &nw, u32 maxnodes, SortWord_t *failed_input);
+
+#endif // _BDD_VERIFIER_H_
@@ -0,0 +1,2051 @@
+/**
+ * @file bp_tester.cpp
+ * @brief Bit-parallel test kernels for candidate sorting networks
+ * @author Bert Dobbelaere bert.o.dobbelaere[at]telenet[dot]be
+ *
+ * Copyright (c) 2022 Bert Dobbelaere
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "bp_tester.h"
+#include "hutils.h"
+#include "prefix_processor.h"
+#include <algorithm>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#define NO_FAILURE ((size_t)-1) ///< Vector index returned by the kernels if all vectors pass
+
+typedef BPWord_t BPVec4_t __attribute__((vector_size(4*sizeof(BPWord_t)))); ///< 256 bit kernel word (AVX2)
+typedef BPWord_t BPVec8_t __attribute__((vector_size(8*sizeof(BPWord_t)))); ///< 512 bit kernel word (AVX-512)
+
+/**
+ * Candidate network as applied by the kernels: each core CE, directly followed by its mirror image for symmetric networks
+ * (unless the CE maps on itself), then the postfix. The expanded network is never materialized.
+ */
+typedef struct
+{
+	const Pair_t *core; ///< Core network
+	size_t corelen;     ///< Number of CEs in the core network
+	bool symmetric;     ///< Apply the mirror image of each core CE
+	const Pair_t *post; ///< Postfix network
+	size_t postlen;     ///< Number of CEs in the postfix network
+	const u8 *layersizes; ///< Number of core CEs in each layer if the core network is layered, NULL otherwise
+	size_t nlayers;       ///< Number of layers in the core network
+} KernelNetwork_t;
+
+/**
+ * Signature of the test kernels
+ * @param ninputs Number of inputs (unused by kernels that are specialized for a fixed number of inputs)
+ * @param nw Network to be tested
+ * @param bpl Bit-parallel test vectors
+ * @param nwords Number of words in bpl
+ * @param failed_output_pattern [OUT] If not NULL, receives the network output for the first failing vector
+ * @return Index of the first failing test vector, or NO_FAILURE
+ */
+typedef size_t (*TestKernel_t)(u8 ninputs, const KernelNetwork_t &nw, const BPWord_t *bpl, size_t nwords, SortWord_t *failed_output_pattern);
+
+/**
+ * Signature of the batch test kernels, see findFirstFailuresT
+ */
+typedef void (*BatchKernel_t)(const KernelNetwork_t nws[], const size_t starts[], size_t count, const BPWord_t *bpl, size_t nwords, size_t failvectors[]);
+
+/**
+ * Signature of the pattern-major test kernels, see findFirstFailurePMT
+ */
+typedef size_t (*PatternKernel_t)(u8 ninputs, const KernelNetwork_t &nw, const SortWord_t *patterns, size_t npatterns, SortWord_t *failed_output_pattern);
+
+/**
+ * Signature of the ternary test kernels, see ternaryGroupT
+ */
+typedef void (*TernaryKernel_t)(u8 ninputs, const KernelNetwork_t &nw, const BPWord_t *lo, const BPWord_t *hi, BPWord_t *possible, BPWord_t *sure);
+
+/**
+ * Signature of the activity kernels, see countSwapsT
+ */
+typedef void (*ActivityKernel_t)(u8 ninputs, const KernelNetwork_t &nw, const BPWord_t *bpl, size_t nwords, uint64_t activity[]);
+
+/**
+ * Extract a single BPWord_t from a kernel word
+ */
+template<typename V> static inline BPWord_t laneWord(const V &v, u32 w)
+{
+	BPWord_t x;
+	memcpy(&x, (const char *)&v + w*sizeof(BPWord_t), sizeof(x));
+	return x;
+}
+
+/**
+ * Find the lowest set bit position in a kernel word
+ * @param accum Kernel word
+ * @return Bit position (lane*PARWORDSIZE+bit), or NO_FAILURE if no bit is set
+ */
+template<typename V>
+static inline __attribute__((always_inline)) size_t firstSetBitT(const V &accum)
+{
+	const u32 lanes=sizeof(V)/sizeof(BPWord_t);
+	for(u32 w=0;w<lanes;w++)
+	{
+		BPWord_t a=laneWord(accum,w);
+		if(a!=0ULL)
+			return w*PARWORDSIZE+__builtin_ctzll(a);
+	}
+	return NO_FAILURE;
+}
+
+/**
+ * Apply two CEs that act on disjoint lines. All loads are issued before the stores, so both CEs execute in parallel.
+ */
+template<typename V>
+static inline __attribute__((always_inline)) void applyTwoT(V data[], u32 i0, u32 j0, u32 i1, u32 j1)
+{
+	V a0=data[i0];
+	V b0=data[j0];
+	V a1=data[i1];
+	V b1=data[j1];
+	data[i0]=a0&b0;
+	data[j0]=a0|b0;
+	data[i1]=a1&b1;
+	data[j1]=a1|b1;
+}
+
+/**
+ * Send a group of bit-parallel test patterns through a layered core network. The CEs within a layer act on disjoint lines,
+ * so they are applied two at a time: a CE together with its mirror image for symmetric networks, pairs of CEs otherwise.
+ * @param data Input/output vectors
+ * @param nw Network to apply, with layer sizes
+ */
+template<typename V, u32 NN>
+static inline __attribute__((always_inline)) void applyLayersT(V data[], const KernelNetwork_t &nw)
+{
+	const Pair_t *p=nw.core;
+	for(size_t l=0;l<nw.nlayers;l++)
+	{
+		size_t n=0;
+		size_t cnt=nw.layersizes[l];
+		if(nw.symmetric)
+		{
+			for(;n<cnt;n++)
+			{
+				u32 i=p[n].lo;
+				u32 j=p[n].hi;
+				if((i+j)!=(NN-1))
+				{
+					applyTwoT(data, i, j, NN-1-j, NN-1-i);
+				}
+				else
+				{
+					V iold=data[i];
+					data[i]&=data[j];
+					data[j]|=iold;
+				}
+			}
+		}
+		else
+		{
+			for(;(n+1)<cnt;n+=2)
+				applyTwoT(data, p[n].lo, p[n].hi, p[n+1].lo, p[n+1].hi);
+			if(n<cnt)
+			{
+				u32 i=p[n].lo;
+				u32 j=p[n].hi;
+				V iold=data[i];
+				data[i]&=data[j];
+				data[j]|=iold;
+			}
+		}
+		p+=cnt;
+	}
+}
+
+/**
+ * Send a group of bit-parallel test patterns through a sorting network.
+ * Each bit position of a kernel word corresponds to an independent data set {0,1}^N to be sorted.
+ * Bit level truth table:
+ * In    Out
+ * 00 ->  00
+ * 01 ->  01
+ * 10 ->  01 ("swap")
+ * 11 ->  11
+ * The kernel word type V determines the number of patterns that are processed together by one and/or pair.
+ * The number of inputs NN is a compile time constant, so that the final sortedness scan is fully unrolled.
+ * Always inlined, so that the instantiation is compiled for the instruction set of the calling wrapper.
+ * @param data Input/output vectors
+ * @param nw Network to apply
+ * @return Position of the first unsorted output in the group (lane*PARWORDSIZE+bit), or NO_FAILURE
+ */
+template<typename V, u32 NN>
+static inline __attribute__((always_inline)) size_t sortGroupT(V data[], const KernelNetwork_t &nw)
+{
+	const Pair_t *p=nw.core;
+	if(nw.layersizes)
+	{
+		applyLayersT<V,NN>(data, nw);
+	}
+	else if(nw.symmetric)
+	{
+		for(size_t n=0;n<nw.corelen;n++)
+		{
+			u32 i=p[n].lo;
+			u32 j=p[n].hi;
+			if((i+j)!=(NN-1)) // Mirror image, unless the CE maps on itself
+			{
+				applyTwoT(data, i, j, NN-1-j, NN-1-i);
+			}
+			else
+			{
+				V iold=data[i];
+				data[i]&=data[j];
+				data[j]|=iold;
+			}
+		}
+	}
+	else
+	{
+		for(size_t n=0;n<nw.corelen;n++)
+		{
+			u32 i=p[n].lo;
+			u32 j=p[n].hi;
+			V iold=data[i];
+			data[i]&=data[j];
+			data[j]|=iold;
+		}
+	}
+	
+	p=nw.post;
+	for(size_t n=0;n<nw.postlen;n++)
+	{
+		u32 i=p[n].lo;
+		u32 j=p[n].hi;
+		V iold=data[i];
+		data[i]&=data[j];
+		data[j]|=iold;
+	}
+	
+	V accum={};
+	for(size_t k=0;k<(NN-1u);k++)
+		accum|= data[k]&~data[k+1]; // Scan for forbidden 1 -> 0 transition
+	return firstSetBitT(accum);
+}
+
+/**
+ * Send groups of bit-parallel test patterns through a sorting network, until a group produces an unsorted output.
+ * @param nw Network to apply
+ * @param bpl Bit-parallel test vectors
+ * @param nwords Number of words in bpl
+ * @param failed_output_pattern [OUT] If not NULL, receives the unsorted output of the first failing vector
+ * @return Index of the first failing vector, or NO_FAILURE
+ */
+template<typename V, u32 NN>
+static inline __attribute__((always_inline)) size_t findFirstFailureT(const KernelNetwork_t &nw, const BPWord_t *bpl, size_t nwords, SortWord_t *failed_output_pattern)
+{
+	const u32 lanes=sizeof(V)/sizeof(BPWord_t);
+	const size_t groupsize=NN*lanes;
+	V data[NN];
+	
+	for(size_t idx=0,groupno=0;idx<nwords;idx+=groupsize,groupno++)
+	{
+		for(size_t k=0;k<NN;k++)
+			memcpy(&data[k], bpl+idx+k*lanes, sizeof(V));
+		
+		size_t pos=sortGroupT<V,NN>(data, nw);
+		if(pos!=NO_FAILURE)
+		{
+			if(failed_output_pattern)
+			{
+				u32 w=pos/PARWORDSIZE;
+				u32 bit=pos%PARWORDSIZE;
+				*failed_output_pattern=0;
+				for(size_t k=0;k<NN;k++)
+					*failed_output_pattern |= ((laneWord(data[k],w)>>bit)&1) << k;
+			}
+			return groupno*lanes*PARWORDSIZE+pos;
+		}
+	}
+	return NO_FAILURE;
+}
+
+/**
+ * Send groups of bit-parallel test patterns through a batch of networks. Each group is loaded once and
+ * then sent through all networks that did not fail yet. A network is dropped from the batch as soon
+ * as it produces an unsorted output.
+ * @param nws Networks to be tested
+ * @param starts Index of the first word to be tested for each network (start of a group, nwords to skip the network)
+ * @param count Number of networks (at most MAXBATCHSIZE)
+ * @param bpl Bit-parallel test vectors
+ * @param nwords Number of words in bpl
+ * @param failvectors [OUT] Index of the first failing vector of each network, or NO_FAILURE
+ */
+template<typename V, u32 NN>
+static inline __attribute__((always_inline)) void findFirstFailuresT(const KernelNetwork_t nws[], const size_t starts[], size_t count, const BPWord_t *bpl, size_t nwords, size_t failvectors[])
+{
+	const u32 lanes=sizeof(V)/sizeof(BPWord_t);
+	const size_t groupsize=NN*lanes;
+	V in[NN];
+	V data[NN];
+	u32 live[MAXBATCHSIZE];
+	size_t nlive=0;
+	size_t first=nwords;
+	
+	for(u32 m=0;m<count;m++)
+	{
+		failvectors[m]=NO_FAILURE;
+		if(starts[m]<nwords)
+			live[nlive++]=m;
+		if(starts[m]<first)
+			first=starts[m];
+	}
+	
+	for(size_t idx=first;(idx<nwords)&&(nlive>0);idx+=groupsize)
+	{
+		for(size_t k=0;k<NN;k++)
+			memcpy(&in[k], bpl+idx+k*lanes, sizeof(V));
+		
+		for(size_t t=0;t<nlive;)
+		{
+			u32 m=live[t];
+			if(idx<starts[m])
+			{
+				t++;
+				continue;
+			}
+			for(size_t k=0;k<NN;k++)
+				data[k]=in[k];
+			size_t pos=sortGroupT<V,NN>(data, nws[m]);
+			if(pos!=NO_FAILURE)
+			{
+				failvectors[m]=(idx/groupsize)*lanes*PARWORDSIZE+pos;
+				live[t]=live[--nlive]; // Retire the network
+			}
+			else
+			{
+				t++;
+			}
+		}
+	}
+}
+
+template<u32 NN>
+static size_t findFirstFailure64(u8, const KernelNetwork_t &nw, const BPWord_t *bpl, size_t nwords, SortWord_t *failed_output_pattern)
+{
+	return findFirstFailureT<BPWord_t,NN>(nw, bpl, nwords, failed_output_pattern);
+}
+
+template<u32 NN>
+__attribute__((target("avx2")))
+static size_t findFirstFailure256(u8, const KernelNetwork_t &nw, const BPWord_t *bpl, size_t nwords, SortWord_t *failed_output_pattern)
+{
+	return findFirstFailureT<BPVec4_t,NN>(nw, bpl, nwords, failed_output_pattern);
+}
+
+template<u32 NN>
+__attribute__((target("avx512f")))
+static size_t findFirstFailure512(u8, const KernelNetwork_t &nw, const BPWord_t *bpl, size_t nwords, SortWord_t *failed_output_pattern)
+{
+	return findFirstFailureT<BPVec8_t,NN>(nw, bpl, nwords, failed_output_pattern);
+}
+
+template<u32 NN>
+static void findFirstFailures64(const KernelNetwork_t nws[], const size_t starts[], size_t count, const BPWord_t *bpl, size_t nwords, size_t failvectors[])
+{
+	findFirstFailuresT<BPWord_t,NN>(nws, starts, count, bpl, nwords, failvectors);
+}
+
+template<u32 NN>
+__attribute__((target("avx2")))
+static void findFirstFailures256(const KernelNetwork_t nws[], const size_t starts[], size_t count, const BPWord_t *bpl, size_t nwords, size_t failvectors[])
+{
+	findFirstFailuresT<BPVec4_t,NN>(nws, starts, count, bpl, nwords, failvectors);
+}
+
+template<u32 NN>
+__attribute__((target("avx512f")))
+static void findFirstFailures512(const KernelNetwork_t nws[], const size_t starts[], size_t count, const BPWord_t *bpl, size_t nwords, size_t failvectors[])
+{
+	findFirstFailuresT<BPVec8_t,NN>(nws, starts, count, bpl, nwords, failvectors);
+}
+
+/**
+ * Apply a CE to a kernel word holding one test vector per lane: bits i and j are exchanged in every lane where bit i is set and bit j is clear
+ */
+template<typename V>
+static inline __attribute__((always_inline)) void applyToPatternsT(V &w, u32 i, u32 j)
+{
+	u32 d=j-i;
+	V t=w&~(w>>d)&(1ULL<<i); // Bit i set, bit j clear
+	w^=t|(t<<d);
+}
+
+/**
+ * Send test vectors, each one stored as a whole SortWord_t, through a sorting network until a vector is not sorted.
+ * Pattern-major counterpart of findFirstFailureT for small sets of test vectors, where most lanes of a line-major group would be empty.
+ * The network is applied to a kernel word holding sizeof(V)/sizeof(SortWord_t) vectors at once.
+ * An output is sorted if its inverted bits form a block of ones starting at bit 0.
+ * @param ninputs Number of inputs
+ * @param nw Network to apply
+ * @param patterns Test vectors, padded with sorted vectors up to a multiple of MAXLANES
+ * @param npatterns Number of test vectors
+ * @param failed_output_pattern [OUT] If not NULL, receives the unsorted output of the first failing vector
+ * @return Index of the first failing vector, or NO_FAILURE
+ */
+template<typename V>
+static inline __attribute__((always_inline)) size_t findFirstFailurePMT(u8 ninputs, const KernelNetwork_t &nw, const SortWord_t *patterns, size_t npatterns, SortWord_t *failed_output_pattern)
+{
+	const u32 lanes=sizeof(V)/sizeof(SortWord_t);
+	const SortWord_t mask=(ninputs<64) ? ((1ULL<<ninputs)-1ULL) : ~0ULL;
+	const u32 mirror=ninputs-1;
+	
+	for(size_t idx=0;idx<npatterns;idx+=lanes)
+	{
+		V w;
+		memcpy(&w, patterns+idx, sizeof(V));
+		
+		for(size_t n=0;n<nw.corelen;n++)
+		{
+			u32 i=nw.core[n].lo;
+			u32 j=nw.core[n].hi;
+			applyToPatternsT(w, i, j);
+			if(nw.symmetric && ((i+j)!=mirror))
+				applyToPatternsT(w, mirror-j, mirror-i);
+		}
+		for(size_t n=0;n<nw.postlen;n++)
+			applyToPatternsT(w, nw.post[n].lo, nw.post[n].hi);
+		
+		V inv=~w&mask;
+		V unsorted=inv&(inv+1);
+		size_t pos=firstSetBitT(unsorted);
+		if(pos!=NO_FAILURE)
+		{
+			u32 lane=pos/PARWORDSIZE;
+			if(failed_output_pattern)
+				*failed_output_pattern=laneWord(w, lane);
+			return idx+lane;
+		}
+	}
+	return NO_FAILURE;
+}
+
+static size_t findFirstFailurePM64(u8 ninputs, const KernelNetwork_t &nw, const SortWord_t *patterns, size_t npatterns, SortWord_t *failed_output_pattern)
+{
+	return findFirstFailurePMT<SortWord_t>(ninputs, nw, patterns, npatterns, failed_output_pattern);
+}
+
+__attribute__((target("avx2")))
+static size_t findFirstFailurePM256(u8 ninputs, const KernelNetwork_t &nw, const SortWord_t *patterns, size_t npatterns, SortWord_t *failed_output_pattern)
+{
+	return findFirstFailurePMT<BPVec4_t>(ninputs, nw, patterns, npatterns, failed_output_pattern);
+}
+
+__attribute__((target("avx512f")))
+static size_t findFirstFailurePM512(u8 ninputs, const KernelNetwork_t &nw, const SortWord_t *patterns, size_t npatterns, SortWord_t *failed_output_pattern)
+{
+	return findFirstFailurePMT<BPVec8_t>(ninputs, nw, patterns, npatterns, failed_output_pattern);
+}
+
+/**
+ * Apply a CE to ternary (0/1/X) values. Each value is represented by a lower and an upper bound bit: 0=(0,0), 1=(1,1), X=(0,1).
+ * Both bounds follow the regular CE operation, since the CE is monotonic.
+ */
+template<typename V>
+static inline __attribute__((always_inline)) void applyTernaryT(V lo[], V hi[], u32 i, u32 j)
+{
+	V lold=lo[i];
+	V hold=hi[i];
+	lo[i]&=lo[j];
+	lo[j]|=lold;
+	hi[i]&=hi[j];
+	hi[j]|=hold;
+}
+
+/**
+ * Send a group of ternary test vectors through a sorting network. Each vector stands for all binary vectors obtained
+ * by replacing its X values by 0 or 1. The CEs are applied in the order of the expanded network, layers are not used.
+ * @param ninputs Number of inputs
+ * @param nw Network to apply
+ * @param lo Lower bounds, same layout as a group of BitParallelList_t
+ * @param hi Upper bounds
+ * @param possible [OUT] Lanes where some of the represented vectors may remain unsorted
+ * @param sure [OUT] Lanes where all of the represented vectors remain unsorted
+ */
+template<typename V>
+static inline __attribute__((always_inline)) void ternaryGroupT(u8 ninputs, const KernelNetwork_t &nw, const BPWord_t *lo, const BPWord_t *hi, BPWord_t *possible, BPWord_t *sure)
+{
+	V l[NMAX];
+	V h[NMAX];
+	const u32 mirror=ninputs-1;
+	for(u32 k=0;k<ninputs;k++)
+	{
+		memcpy(&l[k], lo+k*(sizeof(V)/sizeof(BPWord_t)), sizeof(V));
+		memcpy(&h[k], hi+k*(sizeof(V)/sizeof(BPWord_t)), sizeof(V));
+	}
+	
+	for(size_t n=0;n<nw.corelen;n++)
+	{
+		u32 i=nw.core[n].lo;
+		u32 j=nw.core[n].hi;
+		applyTernaryT(l, h, i, j);
+		if(nw.symmetric && ((i+j)!=mirror))
+			applyTernaryT(l, h, mirror-j, mirror-i);
+	}
+	for(size_t n=0;n<nw.postlen;n++)
+		applyTernaryT(l, h, nw.post[n].lo, nw.post[n].hi);
+	
+	V p={};
+	V s={};
+	for(u32 k=0;k+1<ninputs;k++)
+	{
+		p|=h[k]&~l[k+1]; // Line k may be 1 while line k+1 may be 0
+		s|=l[k]&~h[k+1]; // Line k is 1 while line k+1 is 0
+	}
+	memcpy(possible, &p, sizeof(V));
+	memcpy(sure, &s, sizeof(V));
+}
+
+static void ternaryGroup64(u8 ninputs, const KernelNetwork_t &nw, const BPWord_t *lo, const BPWord_t *hi, BPWord_t *possible, BPWord_t *sure)
+{
+	ternaryGroupT<BPWord_t>(ninputs, nw, lo, hi, possible, sure);
+}
+
+__attribute__((target("avx2")))
+static void ternaryGroup256(u8 ninputs, const KernelNetwork_t &nw, const BPWord_t *lo, const BPWord_t *hi, BPWord_t *possible, BPWord_t *sure)
+{
+	ternaryGroupT<BPVec4_t>(ninputs, nw, lo, hi, possible, sure);
+}
+
+__attribute__((target("avx512f")))
+static void ternaryGroup512(u8 ninputs, const KernelNetwork_t &nw, const BPWord_t *lo, const BPWord_t *hi, BPWord_t *possible, BPWord_t *sure)
+{
+	ternaryGroupT<BPVec8_t>(ninputs, nw, lo, hi, possible, sure);
+}
+
+/**
+ * Count the swaps of a CE on a group of test vectors and apply it
+ */
+template<typename V>
+static inline __attribute__((always_inline)) uint64_t countAndApplyT(V data[], u32 i, u32 j)
+{
+	const u32 lanes=sizeof(V)/sizeof(BPWord_t);
+	V iold=data[i];
+	V swap=iold&~data[j];
+	data[i]&=data[j];
+	data[j]|=iold;
+	
+	uint64_t n=0;
+	for(u32 w=0;w<lanes;w++)
+		n+=__builtin_popcountll(laneWord(swap,w));
+	return n;
+}
+
+/**
+ * Send groups of bit-parallel test patterns through a core network and add the number of swaps of each core CE, including
+ * its mirror image for symmetric networks. The postfix is not applied. Incomplete trailing groups are skipped.
+ * @param ninputs Number of inputs
+ * @param nw Network to apply
+ * @param bpl Bit-parallel test vectors
+ * @param nwords Number of words in bpl
+ * @param activity [IN/OUT] Number of swaps of each core CE
+ */
+template<typename V>
+static inline __attribute__((always_inline)) void countSwapsT(u8 ninputs, const KernelNetwork_t &nw, const BPWord_t *bpl, size_t nwords, uint64_t activity[])
+{
+	const u32 lanes=sizeof(V)/sizeof(BPWord_t);
+	const size_t groupsize=ninputs*lanes;
+	const u32 mirror=ninputs-1;
+	V data[NMAX];
+	
+	for(size_t idx=0;idx+groupsize<=nwords;idx+=groupsize)
+	{
+		for(u32 k=0;k<ninputs;k++)
+			memcpy(&data[k], bpl+idx+k*lanes, sizeof(V));
+		
+		for(size_t n=0;n<nw.corelen;n++)
+		{
+			u32 i=nw.core[n].lo;
+			u32 j=nw.core[n].hi;
+			uint64_t swaps=countAndApplyT(data, i, j);
+			if(nw.symmetric && ((i+j)!=mirror))
+				swaps+=countAndApplyT(data, mirror-j, mirror-i);
+			activity[n]+=swaps;
+		}
+	}
+}
+
+static void countSwaps64(u8 ninputs, const KernelNetwork_t &nw, const BPWord_t *bpl, size_t nwords, uint64_t activity[])
+{
+	countSwapsT<BPWord_t>(ninputs, nw, bpl, nwords, activity);
+}
+
+__attribute__((target("avx2")))
+static void countSwaps256(u8 ninputs, const KernelNetwork_t &nw, const BPWord_t *bpl, size_t nwords, uint64_t activity[])
+{
+	countSwapsT<BPVec4_t>(ninputs, nw, bpl, nwords, activity);
+}
+
+__attribute__((target("avx512f")))
+static void countSwaps512(u8 ninputs, const KernelNetwork_t &nw, const BPWord_t *bpl, size_t nwords, uint64_t activity[])
+{
+	countSwapsT<BPVec8_t>(ninputs, nw, bpl, nwords, activity);
+}
+
+/**
+ * Look up the kernels for a given word size and number of inputs in the dispatch tables.
+ * The tables hold an instantiation for every number of inputs from 2 to NMAX.
+ * @param lanes Number of BPWord_t lanes (1, 4 or 8)
+ * @param ninputs Number of inputs (2..NMAX)
+ * @param test [OUT] Single network kernel
+ * @param batch [OUT] Batch kernel
+ */
+template<size_t... I>
+static void lookupKernels(u32 lanes, u8 ninputs, TestKernel_t &test, BatchKernel_t &batch, std::index_sequence<I...>)
+{
+	static const TestKernel_t kernels64[]={ &findFirstFailure64<I+2>... };
+	static const TestKernel_t kernels256[]={ &findFirstFailure256<I+2>... };
+	static const TestKernel_t kernels512[]={ &findFirstFailure512<I+2>... };
+	static const BatchKernel_t batchkernels64[]={ &findFirstFailures64<I+2>... };
+	static const BatchKernel_t batchkernels256[]={ &findFirstFailures256<I+2>... };
+	static const BatchKernel_t batchkernels512[]={ &findFirstFailures512<I+2>... };
+	
+	switch(lanes)
+	{
+		case 8:
+			test=kernels512[ninputs-2];
+			batch=batchkernels512[ninputs-2];
+			break;
+		case 4:
+			test=kernels256[ninputs-2];
+			batch=batchkernels256[ninputs-2];
+			break;
+		default:
+			test=kernels64[ninputs-2];
+			batch=batchkernels64[ninputs-2];
+			break;
+	}
+}
+
+/*
+ * Ternary testing: the output set of the prefix is the product of the pattern lists of independent line clusters. Instead of
+ * enumerating it, ternary (0/1/X) vectors are sent through the network, each one standing for a subset of the output set.
+ * The pattern list of each cluster is recursively halved, each half is summarized by the AND (lower bound) and OR (upper bound)
+ * of its patterns. A ternary vector combines one node of each cluster's tree. If its output may be unsorted, the largest node is
+ * split and both halves are tested. Vectors with only leaf nodes are binary, so their failures are real.
+ * Binary vectors that caused failures are kept in a cache of regular test vectors, which is tested first.
+ */
+
+/**
+ * Node of the halving tree of a cluster pattern list
+ */
+struct TernaryNode_t{
+	SortWord_t lo;   ///< AND of the patterns in the node
+	SortWord_t hi;   ///< OR of the patterns in the node
+	u32 npatterns;   ///< Number of patterns in the node
+	u32 child[2];    ///< Indices of both halves, unused for leaf nodes
+};
+
+/**
+ * Tester internal kitchen class
+ */
+class BPTester::Data{
+	public:
+		u32 selectTestKernel(u8 ninputs, u32 requested_bits);
+		void setNetworkExpansion(bool symmetric, const Network_t &postfix);
+		void configurePatternMajor(u32 threshold);
+		bool setTestVectors(u8 ninputs, const BitParallelList_t &bpl);
+		bool shareTestVectors(u8 ninputs, const BitParallelList_t &shared, BitParallelList_t &bpl);
+		void setTernaryClusters(const std::vector<SinglePatternList_t> &clusters, u32 cachevectors);
+		void setExhaustiveClusters(u8 ninputs, const std::vector<SinglePatternList_t> &clusters, u32 chunkvectors, u32 cachevectors);
+		void refreshTestVectors(u8 ninputs, const SinglePatternList_t &sample, BitParallelList_t &bpl);
+		void configureCheckpoints(u32 interval, u32 groups);
+		void setReferenceNetwork(u8 ninputs, const Network_t &nw, const BitParallelList_t &bpl);
+		void clearReferenceNetwork();
+		bool testpairsFromPrefixOutput(u8 ninputs, const Network_t &pairs, BitParallelList_t &bpl);
+		void testBatchFromPrefixOutput(u8 ninputs, const std::vector<Network_t> &candidates, BitParallelList_t &bpl, std::vector<bool> &valid);
+		void testLayerBatchFromPrefixOutput(u8 ninputs, const std::vector<LayeredNetwork_t> &candidates, BitParallelList_t &bpl, std::vector<bool> &valid);
+		bool computeActivity(u8 ninputs, const Network_t &core, const BitParallelList_t &bpl, std::vector<uint64_t> &activity);
+		bool testInitialPairsFromPrefixOutput(u8 ninputs, const Network_t &pairs, const BitParallelList_t &bpl, SortWord_t &failed_output_pattern);
+		
+		/* Data members (public) */
+		TestKernel_t testKernel=NULL;         ///< Kernel selected by selectTestKernel
+		BatchKernel_t batchKernel=NULL;       ///< Batch kernel selected by selectTestKernel
+		PatternKernel_t patternKernel=NULL;   ///< Pattern-major kernel selected by selectTestKernel
+		TernaryKernel_t ternaryKernel=NULL;   ///< Ternary kernel selected by selectTestKernel
+		ActivityKernel_t activityKernel=NULL; ///< Activity kernel selected by selectTestKernel
+		u32 kernelLanes=1;                    ///< Number of BPWord_t lanes processed by the kernels
+	private:
+		KernelNetwork_t kernelNetwork(const Network_t &core, size_t start) const;
+		void applyToGroup(BPWord_t *group, u8 ninputs, const Pair_t &p) const;
+		SortWord_t applyToPattern(SortWord_t w, u8 ninputs, const Pair_t &p) const;
+		size_t vectorPosition(u8 ninputs, size_t v, u32 &bit) const;
+		void computeCheckpoints(const BitParallelList_t &bpl, u8 ninputs);
+		void refreshCheckpointSlot(const BitParallelList_t &bpl, u8 ninputs, size_t v);
+		void swapVectors(BitParallelList_t &bpl, u8 ninputs, size_t va, size_t vb);
+		void copyTailVector(BitParallelList_t &bpl, u8 ninputs, size_t v, size_t tailvector);
+		void swapGroups(BitParallelList_t &bpl, u8 ninputs, size_t ga, size_t gb);
+		void rankKillers(BitParallelList_t &bpl, u8 ninputs);
+		void bumpVectorPosition(BitParallelList_t &bpl, u8 ninputs, size_t failvector);
+		size_t testSharedTail(u8 ninputs, const KernelNetwork_t &nw, const BitParallelList_t &bpl, SortWord_t *failed_output_pattern);
+		size_t testPatternMajor(u8 ninputs, const KernelNetwork_t &nw, SortWord_t *failed_output_pattern);
+		void rankPatternKillers();
+		void bumpPatternPosition(size_t failvector);
+		void storeTestVector(BitParallelList_t &bpl, u8 ninputs, size_t v, SortWord_t w);
+		size_t cacheTestVector(BitParallelList_t &bpl, u8 ninputs, SortWord_t w);
+		bool exhaustiveTest(u8 ninputs, const KernelNetwork_t &nw, SortWord_t &failed_input);
+		bool ternaryTest(u8 ninputs, const KernelNetwork_t &nw, SortWord_t &failed_input);
+		bool secondStageTest(u8 ninputs, const KernelNetwork_t &nw, SortWord_t &failed_input);
+		size_t testSecondStage(u8 ninputs, const KernelNetwork_t &nw, BitParallelList_t &bpl);
+		size_t findCheckpoint(const Network_t &nw) const;
+		void bumpFailure(BitParallelList_t &bpl, u8 ninputs, size_t failvector);
+		size_t testCandidate(u8 ninputs, const KernelNetwork_t &nw, const Network_t *core, BitParallelList_t &bpl);
+		void testCandidates(u8 ninputs, const KernelNetwork_t nws[], const Network_t *cores, size_t count, BitParallelList_t &bpl, std::vector<bool> &valid);
+		KernelNetwork_t layeredKernelNetwork(const LayeredNetwork_t &layers, size_t m);
+		
+		bool expandSymmetric=false; ///< Candidate networks are expanded with the mirror image of each CE
+		Network_t fixedPostfix;     ///< Postfix appended to each candidate network
+		
+		/*
+		 * Pattern-major test vectors: used instead of the line-major list when the number of test vectors is small.
+		 */
+		u32 pmThreshold=0;             ///< Maximum number of test vectors for the pattern-major kernel (0=never used)
+		SinglePatternList_t pmVectors; ///< Pattern-major copy of the test vectors, padded to a multiple of MAXLANES
+		size_t pmCount=0;              ///< Number of pattern-major test vectors, 0 if the line-major list is used
+		
+		std::vector<std::vector<TernaryNode_t> > tnTrees; ///< Halving tree of each cluster, root at index 0. Empty if ternary testing is not used.
+		std::vector<u32> tnStack;                         ///< Ternary vectors to be tested, tnTrees.size() node indices per vector
+		BPWord_t tnLo[NMAX*MAXLANES];                     ///< Lower bounds of a group of ternary vectors
+		BPWord_t tnHi[NMAX*MAXLANES];                     ///< Upper bounds of a group of ternary vectors
+		u32 tnBatch[MAXLANES*PARWORDSIZE*NMAX];           ///< Node indices of a group of ternary vectors
+		
+		/*
+		 * Exhaustive second stage: the test vector list only holds a sample of the output set of the prefix. Candidates that pass it
+		 * are tested on the full output set, which is enumerated in chunks from the cluster pattern lists instead of being stored.
+		 */
+		std::vector<SinglePatternList_t> exClusters; ///< Pattern lists of the outer clusters
+		SinglePatternList_t exPatterns;              ///< Output patterns of the inner clusters, in the order of the chunk
+		BitParallelList_t exChunk;                   ///< Bit-parallel chunk: inner patterns combined with one pattern of each outer cluster
+		BitParallelList_t exValid;                   ///< Mask of the used vectors of each word of a chunk line. Empty if the exhaustive stage is not used.
+		SortWord_t exOuterLines=0;                   ///< Lines of the outer clusters
+		
+		/*
+		 * Both second stages store the binary vectors that made candidates fail at the front of the test vector list
+		 */
+		size_t cacheCapacity=0; ///< Maximum number of vectors in the cache of failing binary vectors
+		size_t cacheCount=0;    ///< Number of vectors in the cache of failing binary vectors
+		
+		/*
+		 * Shared test vectors: testers that work with the same prefix share one list of test vectors. Each tester keeps a private copy
+		 * of the leading groups, which it reorders as usual, followed by the whole shared list (the "tail"), which it tests in place.
+		 * A tail vector that makes a candidate fail is copied over a vector of the private killer tier. Private vectors are only copies,
+		 * so none gets lost, and the tail itself is never modified.
+		 */
+		const BPWord_t *tailWords=NULL; ///< First word of the shared list, NULL if the whole list is private
+		size_t tailSize=0;              ///< Number of words of the shared list
+		
+		/*
+		 * Checkpoints: line states of the leading test vector groups, as produced by a reference network (normally the
+		 * last accepted network) after every cpInterval core CEs. A candidate that shares its first CEs with the reference network
+		 * resumes testing of those groups from the last checkpoint before the first difference.
+		 * Within the checkpoints, vectors occupy "slots". Reordering test vectors within the covered groups only updates the
+		 * mapping between slots and vector positions, vectors entering the covered groups are recomputed in the slot they take over.
+		 */
+		u32 cpInterval=0;                        ///< Number of core CEs between checkpoints (0=disabled)
+		u32 cpGroups=0;                          ///< Number of leading vector groups covered by checkpoints
+		Network_t cpNetwork;                     ///< Reference core network
+		size_t cpWords=0;                        ///< Number of words of the test vector list covered by each checkpoint
+		std::vector<BitParallelList_t> cpStates; ///< cpStates[c-1] contains the line states after c*cpInterval core CEs
+		std::vector<u32> cpSlot;                 ///< Checkpoint slot of each covered test vector
+		std::vector<u32> cpVector;               ///< Test vector position of each checkpoint slot
+		
+		/*
+		 * Killer tier, see rankKillers
+		 */
+		std::vector<u32> kScore;         ///< Rejection score of each position of the killer tier
+		size_t kCold=0;                  ///< Positions from kCold to the end of the tier have been replaced since the last ranking
+		u32 kFailures=0;                 ///< Number of failures since the last ranking
+		std::vector<u32> rankOrder;      ///< New order of the killer tier
+		std::vector<u32> rankScores;     ///< Scores of the killer tier in the old order
+		std::vector<u32> rankSlots;      ///< Checkpoint slots of the killer tier in the old order
+		SinglePatternList_t rankVectors; ///< Vectors of the killer tier in the old order
+		
+		/*
+		 * Flattened layered candidates, in the form used by the kernels
+		 */
+		Network_t layerCEs[MAXBATCHSIZE];         ///< CEs of each candidate, layer by layer
+		std::vector<u8> layerSizes[MAXBATCHSIZE]; ///< Number of CEs in each layer of each candidate
+};
+
+u32 BPTester::Data::selectTestKernel(u8 ninputs, u32 requested_bits)
+{
+	__builtin_cpu_init();
+	bool has256=__builtin_cpu_supports("avx2");
+	bool has512=__builtin_cpu_supports("avx512f");
+	
+	if(has512 && ((requested_bits==0) || (requested_bits>=512)))
+	{
+		kernelLanes=8;
+	}
+	else if(has256 && ((requested_bits==0) || (requested_bits>=256)))
+	{
+		kernelLanes=4;
+	}
+	else
+	{
+		kernelLanes=1;
+	}
+	lookupKernels(kernelLanes, ninputs, testKernel, batchKernel, std::make_index_sequence<NMAX-1>());
+	switch(kernelLanes)
+	{
+		case 8:
+			patternKernel=findFirstFailurePM512;
+			ternaryKernel=ternaryGroup512;
+			activityKernel=countSwaps512;
+			break;
+		case 4:
+			patternKernel=findFirstFailurePM256;
+			ternaryKernel=ternaryGroup256;
+			activityKernel=countSwaps256;
+			break;
+		default:
+			patternKernel=findFirstFailurePM64;
+			ternaryKernel=ternaryGroup64;
+			activityKernel=countSwaps64;
+			break;
+	}
+	return kernelLanes;
+}
+
+void BPTester::Data::setNetworkExpansion(bool symmetric, const Network_t &postfix)
+{
+	expandSymmetric=symmetric;
+	fixedPostfix=postfix;
+	clearReferenceNetwork();
+}
+
+/**
+ * Kernel view of a candidate core network
+ * @param core Core network
+ * @param start Index of the first core CE to apply
+ */
+inline KernelNetwork_t BPTester::Data::kernelNetwork(const Network_t &core, size_t start) const
+{
+	KernelNetwork_t nw={core.data()+start, core.size()-start, expandSymmetric, fixedPostfix.data(), fixedPostfix.size(), NULL, 0};
+	return nw;
+}
+
+/**
+ * Apply a core CE, followed by its mirror image if applicable, to one group of test vectors
+ * @param group First word of the group
+ * @param ninputs Number of inputs
+ * @param p Core CE
+ */
+void BPTester::Data::applyToGroup(BPWord_t *group, u8 ninputs, const Pair_t &p) const
+{
+	Pair_t ces[2]={p, {(u8)(ninputs-1-p.hi), (u8)(ninputs-1-p.lo)}};
+	u32 nces=(expandSymmetric && ((p.lo+p.hi)!=(ninputs-1))) ? 2 : 1;
+	
+	for(u32 n=0;n<nces;n++)
+	{
+		BPWord_t *di=group+ces[n].lo*kernelLanes;
+		BPWord_t *dj=group+ces[n].hi*kernelLanes;
+		for(u32 w=0;w<kernelLanes;w++)
+		{
+			BPWord_t iold=di[w];
+			di[w]&=dj[w];
+			dj[w]|=iold;
+		}
+	}
+}
+
+/**
+ * Apply a core CE, followed by its mirror image if applicable, to a single test vector
+ * @param w Test vector
+ * @param ninputs Number of inputs
+ * @param p Core CE
+ * @return Resulting vector
+ */
+inline SortWord_t BPTester::Data::applyToPattern(SortWord_t w, u8 ninputs, const Pair_t &p) const
+{
+	SortWord_t swap=((w>>p.lo)&~(w>>p.hi))&1;
+	w^=(swap<<p.lo)|(swap<<p.hi);
+	if(expandSymmetric && ((p.lo+p.hi)!=(ninputs-1)))
+	{
+		u32 slo=ninputs-1-p.hi;
+		u32 shi=ninputs-1-p.lo;
+		swap=((w>>slo)&~(w>>shi))&1;
+		w^=(swap<<slo)|(swap<<shi);
+	}
+	return w;
+}
+
+void BPTester::Data::configurePatternMajor(u32 threshold)
+{
+	pmThreshold=threshold;
+}
+
+void BPTester::Data::configureCheckpoints(u32 interval, u32 groups)
+{
+	cpInterval=interval;
+	cpGroups=groups;
+	clearReferenceNetwork();
+}
+
+void BPTester::Data::clearReferenceNetwork()
+{
+	cpNetwork.clear();
+	cpStates.clear();
+	cpWords=0;
+}
+
+/**
+ * Locate a test vector in a block of test vectors
+ * @param ninputs Number of inputs
+ * @param v Vector index
+ * @param bit [OUT] Bit position of the vector
+ * @return Word index of line 0 of the vector. Further lines are found at a stride of kernelLanes words.
+ */
+inline size_t BPTester::Data::vectorPosition(u8 ninputs, size_t v, u32 &bit) const
+{
+	const size_t groupvectors=kernelLanes*PARWORDSIZE;
+	bit=v%PARWORDSIZE;
+	return (v/groupvectors)*ninputs*kernelLanes + (v%groupvectors)/PARWORDSIZE;
+}
+
+/**
+ * Transpose a 64x64 bit matrix: bit k of word v moves to bit v of word k
+ * @param words [IN/OUT] Matrix, one row per word
+ */
+static void transposeWords(BPWord_t words[PARWORDSIZE])
+{
+	BPWord_t m=0x00000000FFFFFFFFULL;
+	for(u32 j=PARWORDSIZE/2;j>0;j>>=1,m^=m<<j)
+	{
+		for(u32 k=0;k<PARWORDSIZE;k=((k|j)+1)&~j)
+		{
+			BPWord_t t=((words[k]>>j)^words[k|j])&m;
+			words[k]^=t<<j;
+			words[k|j]^=t;
+		}
+	}
+}
+
+/**
+ * Recompute all checkpoints from the test vectors, with slots in the same order as the vectors
+ * @param bpl List of test vectors
+ * @param ninputs Number of inputs
+ */
+void BPTester::Data::computeCheckpoints(const BitParallelList_t &bpl, u8 ninputs)
+{
+	BitParallelList_t state(bpl.begin(), bpl.begin()+cpWords);
+	for(size_t c=1;c<=cpStates.size();c++)
+	{
+		for(size_t idx=0;idx<cpWords;idx+=ninputs*kernelLanes)
+		{
+			for(size_t n=(c-1)*cpInterval;n<c*cpInterval;n++)
+				applyToGroup(&state[idx], ninputs, cpNetwork[n]);
+		}
+		cpStates[c-1]=state;
+	}
+	
+	size_t nvectors=(cpWords/ninputs)*PARWORDSIZE;
+	cpSlot.resize(nvectors);
+	cpVector.resize(nvectors);
+	for(size_t v=0;v<nvectors;v++)
+	{
+		cpSlot[v]=v;
+		cpVector[v]=v;
+	}
+}
+
+void BPTester::Data::setReferenceNetwork(u8 ninputs, const Network_t &nw, const BitParallelList_t &bpl)
+{
+	if((cpInterval==0) || (pmCount>0) || !tnTrees.empty() || !exValid.empty())
+		return;
+	
+	cpNetwork=nw;
+	cpWords=std::min((size_t)cpGroups*ninputs*kernelLanes, bpl.size());
+	cpStates.resize(nw.size()/cpInterval);
+	computeCheckpoints(bpl, ninputs);
+}
+
+/**
+ * Recompute the checkpoint states of a single slot, by sending a test vector through the reference network
+ * @param bpl List of test vectors
+ * @param ninputs Number of inputs
+ * @param v Vector index, its checkpoint slot will be overwritten
+ */
+void BPTester::Data::refreshCheckpointSlot(const BitParallelList_t &bpl, u8 ninputs, size_t v)
+{
+	u32 bit;
+	size_t idx=vectorPosition(ninputs, v, bit);
+	SortWord_t w=0;
+	for(size_t k=0;k<ninputs;k++)
+		w|=((bpl[idx+k*kernelLanes]>>bit)&1)<<k;
+	
+	idx=vectorPosition(ninputs, cpSlot[v], bit);
+	for(size_t c=1;c<=cpStates.size();c++)
+	{
+		for(size_t n=(c-1)*cpInterval;n<c*cpInterval;n++)
+			w=applyToPattern(w, ninputs, cpNetwork[n]);
+		BPWord_t *state=cpStates[c-1].data();
+		for(size_t k=0;k<ninputs;k++)
+		{
+			BPWord_t &s=state[idx+k*kernelLanes];
+			s=(s&~(1ULL<<bit))|(((w>>k)&1)<<bit);
+		}
+	}
+}
+
+/**
+ * Exchange two test vectors, identified by their index in the list, and keep the checkpoints up to date
+ * @param bpl List of test vectors
+ * @param ninputs Number of inputs
+ * @param va Index of first vector
+ * @param vb Index of second vector
+ */
+void BPTester::Data::swapVectors(BitParallelList_t &bpl, u8 ninputs, size_t va, size_t vb)
+{
+	u32 ba,bb;
+	size_t ia=vectorPosition(ninputs, va, ba);
+	size_t ib=vectorPosition(ninputs, vb, bb);
+	
+	for(size_t k=0;k<ninputs;k++)
+	{
+		BPWord_t x=((bpl[ia]>>ba)^(bpl[ib]>>bb))&1;
+		bpl[ia]^=x<<ba;
+		bpl[ib]^=x<<bb;
+		ia+=kernelLanes;
+		ib+=kernelLanes;
+	}
+	
+	const size_t cpvectors=cpSlot.size();
+	if(cpWords==0)
+	{
+		// No checkpoints
+	}
+	else if((va<cpvectors) && (vb<cpvectors))
+	{
+		std::swap(cpSlot[va],cpSlot[vb]);
+		cpVector[cpSlot[va]]=va;
+		cpVector[cpSlot[vb]]=vb;
+	}
+	else if(va<cpvectors)
+	{
+		refreshCheckpointSlot(bpl, ninputs, va);
+	}
+	else if(vb<cpvectors)
+	{
+		refreshCheckpointSlot(bpl, ninputs, vb);
+	}
+}
+
+/**
+ * Copy a vector of the shared tail over a vector of the private test vector list, and keep the checkpoints up to date
+ * @param bpl Private list of test vectors
+ * @param ninputs Number of inputs
+ * @param v Index of the vector to overwrite
+ * @param tailvector Index of the vector in the shared tail
+ */
+void BPTester::Data::copyTailVector(BitParallelList_t &bpl, u8 ninputs, size_t v, size_t tailvector)
+{
+	u32 bit,tailbit;
+	size_t idx=vectorPosition(ninputs, v, bit);
+	size_t tailidx=vectorPosition(ninputs, tailvector, tailbit);
+	
+	for(size_t k=0;k<ninputs;k++)
+	{
+		BPWord_t &b=bpl[idx+k*kernelLanes];
+		b=(b&~(1ULL<<bit))|(((tailWords[tailidx+k*kernelLanes]>>tailbit)&1)<<bit);
+	}
+	
+	if((cpWords>0) && (v<cpSlot.size()))
+	{
+		refreshCheckpointSlot(bpl, ninputs, v);
+	}
+}
+
+/**
+ * Exchange two groups of test vectors, and keep the checkpoints up to date
+ * @param bpl List of test vectors
+ * @param ninputs Number of inputs
+ * @param ga Index of first word of the first group
+ * @param gb Index of first word of the second group (ga<gb)
+ */
+void BPTester::Data::swapGroups(BitParallelList_t &bpl, u8 ninputs, size_t ga, size_t gb)
+{
+	const size_t groupsize=ninputs*kernelLanes;
+	std::swap_ranges(bpl.begin()+ga, bpl.begin()+ga+groupsize, bpl.begin()+gb);
+	
+	if(ga<cpWords)
+	{
+		computeCheckpoints(bpl, ninputs);
+	}
+}
+
+/*
+ * Killer vectors: the first group of test vectors, which rejects most failing candidates, is a tier of "killer" vectors.
+ * Each position of the tier has a rejection score, that is incremented whenever its vector is the first to fail, and halved
+ * every KILLER_DECAY_PERIOD failures. The tier is then sorted by decreasing score. A vector from the tail of the list that
+ * rejects a candidate takes the place of the coldest killer vector, which drops to the tail.
+ * With pattern-major test vectors, the tier consists of the leading vectors of the pattern-major list, see bumpPatternPosition.
+ */
+#define KILLER_HIT (16u)             ///< Score increment per rejected candidate
+#define KILLER_DECAY_PERIOD (4096u)  ///< Number of failures between score decays and rankings of the tier
+
+/**
+ * Sort the killer tier by decreasing score, after halving the scores. Checkpoint slots follow their vectors.
+ * @param bpl List of test vectors
+ * @param ninputs Number of inputs
+ */
+void BPTester::Data::rankKillers(BitParallelList_t &bpl, u8 ninputs)
+{
+	const size_t n=kScore.size();
+	std::vector<u32> &order=rankOrder;
+	std::vector<u32> &scores=rankScores;
+	std::vector<u32> &slots=rankSlots;
+	SinglePatternList_t &vectors=rankVectors;
+	
+	order.resize(n);
+	for(size_t v=0;v<n;v++)
+	{
+		order[v]=v;
+		kScore[v]>>=1;
+	}
+	std::stable_sort(order.begin(), order.end(), [this](u32 a, u32 b) { return kScore[a]>kScore[b];});
+	
+	// Read the tier as single patterns, 64 vectors at a time
+	vectors.resize(n);
+	for(size_t v=0;v<n;v+=PARWORDSIZE)
+	{
+		BPWord_t words[PARWORDSIZE]={};
+		u32 bit;
+		size_t idx=vectorPosition(ninputs, v, bit);
+		for(size_t k=0;k<ninputs;k++)
+			words[k]=bpl[idx+k*kernelLanes];
+		transposeWords(words);
+		std::copy(words, words+PARWORDSIZE, vectors.begin()+v);
+	}
+	
+	// Write them back in the new order
+	for(size_t v=0;v<n;v+=PARWORDSIZE)
+	{
+		BPWord_t words[PARWORDSIZE];
+		for(size_t i=0;i<PARWORDSIZE;i++)
+			words[i]=vectors[order[v+i]];
+		transposeWords(words);
+		u32 bit;
+		size_t idx=vectorPosition(ninputs, v, bit);
+		for(size_t k=0;k<ninputs;k++)
+			bpl[idx+k*kernelLanes]=words[k];
+	}
+	
+	scores=kScore;
+	for(size_t v=0;v<n;v++)
+		kScore[v]=scores[order[v]];
+	if(cpSlot.size()>=n)
+	{
+		slots.assign(cpSlot.begin(), cpSlot.begin()+n);
+		for(size_t v=0;v<n;v++)
+		{
+			cpSlot[v]=slots[order[v]];
+			cpVector[cpSlot[v]]=v;
+		}
+	}
+	kCold=n;
+}
+
+/**
+ * Test vector reordering after a failure - speeds up rejection of failing networks by keeping the vectors that reject most
+ * candidates in the first group, see the description of the killer tier above.
+ * Note that to accept a sorting network, still all test vectors need to pass, no shortcuts are taken.
+ * @param bpl List of test vectors matching the prefix (regrouped for parallel execution)
+ * @param ninputs Number of inputs
+ * @param failvector Index of first failing vector
+ */
+void BPTester::Data::bumpVectorPosition(BitParallelList_t &bpl, u8 ninputs, size_t failvector)
+{
+	if(failvector<kScore.size())
+	{
+		kScore[failvector]+=KILLER_HIT;
+	}
+	else
+	{
+		// Replace the coldest killer vector that was not replaced yet since the last ranking
+		if(kCold==0)
+			kCold=kScore.size();
+		kCold--;
+		kScore[kCold]=KILLER_HIT;
+		
+		const size_t nprivate=(bpl.size()/ninputs)*PARWORDSIZE;
+		if(tailWords && (failvector>=nprivate))
+		{
+			copyTailVector(bpl, ninputs, kCold, failvector-nprivate);
+		}
+		else
+		{
+			swapVectors(bpl, ninputs, kCold, failvector);
+			
+			// Tail groups are not ranked individually: move the failing group about 1/8 the distance to the front
+			const size_t groupsize=ninputs*kernelLanes;
+			size_t groupno=failvector/kScore.size();
+			if(groupno>1)
+			{
+				size_t idx=groupsize*groupno;
+				size_t delta=groupsize*((groupno+7)/8);
+				swapGroups(bpl, ninputs, idx-delta, idx);
+			}
+		}
+	}
+	
+	if(++kFailures>=KILLER_DECAY_PERIOD)
+	{
+		kFailures=0;
+		rankKillers(bpl, ninputs);
+	}
+}
+
+bool BPTester::Data::setTestVectors(u8 ninputs, const BitParallelList_t &bpl)
+{
+	clearReferenceNetwork(); // Checkpoints belong to the previous test vectors
+	pmVectors.clear();
+	pmCount=0;
+	tnTrees.clear();
+	exClusters.clear();
+	exValid.clear();
+	tailWords=NULL;
+	tailSize=0;
+	kScore.assign(kernelLanes*PARWORDSIZE, 0);
+	kCold=kScore.size();
+	kFailures=0;
+	
+	// Count the test vectors, the last group is padded with all-zero vectors
+	const size_t groupsize=ninputs*kernelLanes;
+	size_t nvectors=0;
+	if(bpl.size()>0)
+	{
+		size_t idx=bpl.size()-groupsize;
+		BPWord_t used[MAXLANES]={};
+		for(size_t k=0;k<ninputs;k++)
+			for(u32 w=0;w<kernelLanes;w++)
+				used[w]|=bpl[idx+k*kernelLanes+w];
+		nvectors=(idx/ninputs)*PARWORDSIZE;
+		for(u32 w=0;w<kernelLanes;w++)
+		{
+			if(used[w]!=0ULL)
+				nvectors=(idx/ninputs)*PARWORDSIZE+w*PARWORDSIZE+(PARWORDSIZE-__builtin_clzll(used[w]));
+		}
+	}
+	
+	if((nvectors==0) || (nvectors>pmThreshold))
+		return false;
+	
+	pmVectors.resize(((nvectors+MAXLANES-1)/MAXLANES)*MAXLANES, 0ULL);
+	for(size_t v=0;v<nvectors;v++)
+	{
+		u32 bit;
+		size_t idx=vectorPosition(ninputs, v, bit);
+		for(size_t k=0;k<ninputs;k++)
+			pmVectors[v]|=((bpl[idx+k*kernelLanes]>>bit)&1)<<k;
+	}
+	pmCount=nvectors;
+	kScore.resize(std::min(kScore.size(), pmCount)); // The killer tier of the pattern-major list
+	kCold=kScore.size();
+	return true;
+}
+
+bool BPTester::Data::shareTestVectors(u8 ninputs, const BitParallelList_t &shared, BitParallelList_t &bpl)
+{
+	bool patternmajor=setTestVectors(ninputs, shared);
+	size_t nprivate=shared.size();
+	if(!patternmajor)
+	{
+		// The checkpoints need private groups, the killer tier always has one
+		nprivate=std::min((size_t)std::max(cpGroups,1u)*ninputs*kernelLanes, shared.size());
+	}
+	bpl.assign(shared.begin(), shared.begin()+nprivate);
+	if(nprivate<shared.size())
+	{
+		tailWords=shared.data();
+		tailSize=shared.size();
+	}
+	return patternmajor;
+}
+
+/**
+ * Test a candidate network on the shared tail of the test vectors, once it passed the private list
+ * @param ninputs Number of inputs
+ * @param nw Kernel view of the candidate
+ * @param bpl Private list of test vectors
+ * @param failed_output_pattern [OUT] If not NULL, receives the unsorted output of the first failing vector
+ * @return Index of the first failing vector, counting on from the private list, or NO_FAILURE
+ */
+inline size_t BPTester::Data::testSharedTail(u8 ninputs, const KernelNetwork_t &nw, const BitParallelList_t &bpl, SortWord_t *failed_output_pattern)
+{
+	if(tailSize==0)
+		return NO_FAILURE;
+	size_t failvector=testKernel(ninputs, nw, tailWords, tailSize, failed_output_pattern);
+	if(failvector!=NO_FAILURE)
+		failvector+=(bpl.size()/ninputs)*PARWORDSIZE;
+	return failvector;
+}
+
+/**
+ * Test a candidate network on the pattern-major test vectors
+ * @param ninputs Number of inputs
+ * @param nw Kernel view of the candidate
+ * @param failed_output_pattern [OUT] If not NULL, receives the unsorted output of the first failing vector
+ * @return Index of the first failing vector, or NO_FAILURE
+ */
+inline size_t BPTester::Data::testPatternMajor(u8 ninputs, const KernelNetwork_t &nw, SortWord_t *failed_output_pattern)
+{
+	return patternKernel(ninputs, nw, pmVectors.data(), pmCount, failed_output_pattern);
+}
+
+/**
+ * Sort the killer tier of the pattern-major list by decreasing score, after halving the scores, see rankKillers
+ */
+void BPTester::Data::rankPatternKillers()
+{
+	const size_t n=kScore.size();
+	std::vector<u32> &order=rankOrder;
+	std::vector<u32> &scores=rankScores;
+	SinglePatternList_t &vectors=rankVectors;
+	
+	order.resize(n);
+	for(size_t v=0;v<n;v++)
+	{
+		order[v]=v;
+		kScore[v]>>=1;
+	}
+	std::stable_sort(order.begin(), order.end(), [this](u32 a, u32 b) { return kScore[a]>kScore[b];});
+	
+	vectors.assign(pmVectors.begin(), pmVectors.begin()+n);
+	scores=kScore;
+	for(size_t v=0;v<n;v++)
+	{
+		pmVectors[v]=vectors[order[v]];
+		kScore[v]=scores[order[v]];
+	}
+	kCold=n;
+}
+
+/**
+ * Pattern-major counterpart of bumpVectorPosition: the leading vectors of the pattern-major list form the killer tier
+ * @param failvector Index of the failing vector
+ */
+void BPTester::Data::bumpPatternPosition(size_t failvector)
+{
+	if(failvector<kScore.size())
+	{
+		kScore[failvector]+=KILLER_HIT;
+	}
+	else
+	{
+		// Replace the coldest killer vector that was not replaced yet since the last ranking
+		if(kCold==0)
+			kCold=kScore.size();
+		kCold--;
+		kScore[kCold]=KILLER_HIT;
+		std::swap(pmVectors[kCold], pmVectors[failvector]);
+	}
+	
+	if(++kFailures>=KILLER_DECAY_PERIOD)
+	{
+		kFailures=0;
+		rankPatternKillers();
+	}
+}
+
+/**
+ * Build the halving tree of part of a cluster pattern list
+ * @param tree [IN/OUT] Tree under construction
+ * @param patterns Cluster pattern list
+ * @param first Index of the first pattern in the node
+ * @param last Index beyond the last pattern in the node
+ * @return Index of the node
+ */
+static u32 buildTernaryTree(std::vector<TernaryNode_t> &tree, const SinglePatternList_t &patterns, size_t first, size_t last)
+{
+	u32 idx=tree.size();
+	tree.push_back(TernaryNode_t());
+	
+	TernaryNode_t node;
+	node.npatterns=last-first;
+	node.lo=~0ULL;
+	node.hi=0;
+	for(size_t k=first;k<last;k++)
+	{
+		node.lo&=patterns[k];
+		node.hi|=patterns[k];
+	}
+	node.child[0]=0;
+	node.child[1]=0;
+	if(node.npatterns>1)
+	{
+		size_t mid=(first+last)/2;
+		node.child[0]=buildTernaryTree(tree, patterns, first, mid);
+		node.child[1]=buildTernaryTree(tree, patterns, mid, last);
+	}
+	tree[idx]=node;
+	return idx;
+}
+
+void BPTester::Data::setTernaryClusters(const std::vector<SinglePatternList_t> &clusters, u32 cachevectors)
+{
+	tnTrees.resize(clusters.size());
+	for(size_t c=0;c<clusters.size();c++)
+	{
+		tnTrees[c].clear();
+		buildTernaryTree(tnTrees[c], clusters[c], 0, clusters[c].size());
+	}
+	cacheCapacity=std::max(cachevectors, 1u);
+	cacheCount=0;
+	pmVectors.clear();
+	pmCount=0;
+	if(kScore.size()!=kernelLanes*PARWORDSIZE) // The killer tier was that of the pattern-major list
+	{
+		kScore.assign(kernelLanes*PARWORDSIZE, 0);
+		kCold=kScore.size();
+	}
+	clearReferenceNetwork();
+}
+
+/**
+ * Store a binary vector in a list of test vectors, growing the list if needed
+ * @param bpl List of test vectors
+ * @param ninputs Number of inputs
+ * @param v Vector position
+ * @param w Vector to store
+ */
+void BPTester::Data::storeTestVector(BitParallelList_t &bpl, u8 ninputs, size_t v, SortWord_t w)
+{
+	const size_t groupvectors=kernelLanes*PARWORDSIZE;
+	size_t groups=(v/groupvectors)+1;
+	if(bpl.size()<groups*ninputs*kernelLanes)
+		bpl.resize(groups*ninputs*kernelLanes, 0ULL);
+	
+	u32 bit;
+	size_t idx=vectorPosition(ninputs, v, bit);
+	for(size_t k=0;k<ninputs;k++)
+	{
+		BPWord_t &b=bpl[idx+k*kernelLanes];
+		b=(b&~(1ULL<<bit))|(((w>>k)&1)<<bit);
+	}
+}
+
+/**
+ * Store a binary vector in the cache of failing vectors. If the cache is full, the vector replaces the last one.
+ * @param bpl Cache of failing vectors
+ * @param ninputs Number of inputs
+ * @param w Vector to store
+ * @return Index of the vector in the cache
+ */
+size_t BPTester::Data::cacheTestVector(BitParallelList_t &bpl, u8 ninputs, SortWord_t w)
+{
+	size_t v=(cacheCount<cacheCapacity) ? cacheCount++ : (cacheCount-1);
+	storeTestVector(bpl, ninputs, v, w);
+	return v;
+}
+
+void BPTester::Data::refreshTestVectors(u8 ninputs, const SinglePatternList_t &sample, BitParallelList_t &bpl)
+{
+	// The cached failing vectors stay in front, the sample takes the positions after them
+	const size_t groupvectors=kernelLanes*PARWORDSIZE;
+	size_t nvectors=cacheCount+sample.size();
+	bpl.resize(((nvectors+groupvectors-1)/groupvectors)*ninputs*kernelLanes, 0ULL);
+	for(size_t v=0;v<sample.size();v++)
+	{
+		storeTestVector(bpl, ninputs, cacheCount+v, sample[v]);
+	}
+	for(size_t v=nvectors;v<(bpl.size()/ninputs)*PARWORDSIZE;v++)
+	{
+		storeTestVector(bpl, ninputs, v, 0ULL);
+	}
+}
+
+void BPTester::Data::setExhaustiveClusters(u8 ninputs, const std::vector<SinglePatternList_t> &clusters, u32 chunkvectors, u32 cachevectors)
+{
+	// The leading clusters whose product fits in a chunk are "inner" clusters, the others "outer" clusters
+	size_t ninner=0;
+	uint64_t chunksize=1;
+	while((ninner<clusters.size()) && ((ninner==0) || (chunksize*clusters[ninner].size()<=chunkvectors)))
+	{
+		chunksize*=clusters[ninner].size();
+		ninner++;
+	}
+	std::vector<SinglePatternList_t> inner(clusters.begin(), clusters.begin()+ninner);
+	enumeratePrefixOutputs(inner, 0, chunksize, exPatterns);
+	exClusters.assign(clusters.begin()+ninner, clusters.end());
+	exOuterLines=0;
+	for(size_t c=0;c<exClusters.size();c++)
+		exOuterLines|=exClusters[c].back(); // Largest pattern of a cluster has all its lines set
+	
+	// The inner patterns are packed once, chunks only differ in the (constant) lines of the outer clusters
+	const size_t groupvectors=kernelLanes*PARWORDSIZE;
+	size_t ngroups=(exPatterns.size()+groupvectors-1)/groupvectors;
+	exChunk.assign(ngroups*ninputs*kernelLanes, 0ULL);
+	exValid.assign(ngroups*kernelLanes, 0ULL);
+	for(size_t v=0;v<exPatterns.size();v+=PARWORDSIZE)
+	{
+		BPWord_t words[PARWORDSIZE]={};
+		size_t n=std::min(exPatterns.size()-v, (size_t)PARWORDSIZE);
+		std::copy(exPatterns.begin()+v, exPatterns.begin()+v+n, words);
+		transposeWords(words);
+		
+		u32 bit;
+		size_t idx=vectorPosition(ninputs, v, bit);
+		for(size_t k=0;k<ninputs;k++)
+			exChunk[idx+k*kernelLanes]=words[k];
+		exValid[v/PARWORDSIZE]=(n<PARWORDSIZE) ? ((1ULL<<n)-1) : ~0ULL;
+	}
+	
+	cacheCapacity=std::max(cachevectors, 1u);
+	cacheCount=0;
+	pmVectors.clear();
+	pmCount=0;
+	if(kScore.size()!=kernelLanes*PARWORDSIZE) // The killer tier was that of the pattern-major list
+	{
+		kScore.assign(kernelLanes*PARWORDSIZE, 0);
+		kCold=kScore.size();
+	}
+	clearReferenceNetwork();
+}
+
+/**
+ * Test a candidate network on the full output set of the prefix, enumerated chunk by chunk
+ * @param ninputs Number of inputs
+ * @param nw Kernel view of the candidate
+ * @param failed_input [OUT] Output pattern of the prefix for which the network fails
+ * @return true if the network sorts the full output set of the prefix
+ */
+bool BPTester::Data::exhaustiveTest(u8 ninputs, const KernelNetwork_t &nw, SortWord_t &failed_input)
+{
+	const size_t ngroups=exValid.size()/kernelLanes;
+	const size_t nouter=exClusters.size();
+	size_t digits[NMAX]={};
+	SortWord_t outer=0;
+	
+	for(size_t c=0;c<nouter;c++)
+		outer|=exClusters[c][0];
+	
+	for(;;)
+	{
+		for(size_t k=0;k<ninputs;k++)
+		{
+			if((exOuterLines>>k)&1)
+			{
+				BPWord_t sel=((outer>>k)&1) ? ~0ULL : 0ULL;
+				for(size_t g=0;g<ngroups;g++)
+					for(u32 w=0;w<kernelLanes;w++)
+						exChunk[(g*ninputs+k)*kernelLanes+w]=exValid[g*kernelLanes+w]&sel;
+			}
+		}
+		
+		size_t failvector=testKernel(ninputs, nw, exChunk.data(), exChunk.size(), NULL);
+		if(failvector!=NO_FAILURE)
+		{
+			failed_input=exPatterns[failvector]|outer;
+			return false;
+		}
+		
+		// Next combination of outer cluster patterns
+		size_t c=0;
+		while(c<nouter)
+		{
+			outer&=~exClusters[c][digits[c]];
+			if(++digits[c]<exClusters[c].size())
+			{
+				outer|=exClusters[c][digits[c]];
+				break;
+			}
+			digits[c]=0;
+			outer|=exClusters[c][0];
+			c++;
+		}
+		if(c==nouter)
+			return true;
+	}
+}
+
+/**
+ * Test a candidate network on the full output set of the prefix with ternary vectors
+ * @param ninputs Number of inputs
+ * @param nw Kernel view of the candidate
+ * @param failed_input [OUT] Binary input vector for which the network fails
+ * @return true if the network sorts the full output set of the prefix
+ */
+bool BPTester::Data::ternaryTest(u8 ninputs, const KernelNetwork_t &nw, SortWord_t &failed_input)
+{
+	const size_t nclusters=tnTrees.size();
+	const size_t groupvectors=kernelLanes*PARWORDSIZE;
+	BPWord_t *lo=tnLo;
+	BPWord_t *hi=tnHi;
+	u32 *batch=tnBatch;
+	BPWord_t possible[MAXLANES];
+	BPWord_t sure[MAXLANES];
+	
+	tnStack.assign(nclusters, 0); // Root of all trees
+	while(!tnStack.empty())
+	{
+		// Take the ternary vectors that were added last: depth first search, to bound the size of the stack
+		size_t nvectors=std::min(tnStack.size()/nclusters, groupvectors);
+		size_t start=tnStack.size()-nvectors*nclusters;
+		memcpy(batch, &tnStack[start], nvectors*nclusters*sizeof(u32));
+		tnStack.resize(start);
+		
+		memset(lo, 0, ninputs*kernelLanes*sizeof(BPWord_t));
+		memset(hi, 0, ninputs*kernelLanes*sizeof(BPWord_t));
+		for(size_t v=0;v<nvectors;v++)
+		{
+			SortWord_t l=0;
+			SortWord_t h=0;
+			for(size_t c=0;c<nclusters;c++)
+			{
+				const TernaryNode_t &node=tnTrees[c][batch[v*nclusters+c]];
+				l|=node.lo;
+				h|=node.hi;
+			}
+			u32 w=v/PARWORDSIZE;
+			BPWord_t bit=1ULL<<(v%PARWORDSIZE);
+			for(u32 k=0;k<ninputs;k++)
+			{
+				if((l>>k)&1)
+					lo[k*kernelLanes+w]|=bit;
+				if((h>>k)&1)
+					hi[k*kernelLanes+w]|=bit;
+			}
+		}
+		
+		ternaryKernel(ninputs, nw, lo, hi, possible, sure);
+		
+		for(size_t v=0;v<nvectors;v++)
+		{
+			u32 w=v/PARWORDSIZE;
+			u32 bit=v%PARWORDSIZE;
+			if(((possible[w]>>bit)&1)==0)
+				continue; // All represented vectors are sorted
+			
+			// Find the largest node to split, and a binary vector represented by the ternary vector
+			const u32 *nodes=&batch[v*nclusters];
+			size_t split=nclusters;
+			u32 largest=1;
+			failed_input=0;
+			for(size_t c=0;c<nclusters;c++)
+			{
+				const TernaryNode_t *node=&tnTrees[c][nodes[c]];
+				if(node->npatterns>largest)
+				{
+					largest=node->npatterns;
+					split=c;
+				}
+				while(node->npatterns>1)
+					node=&tnTrees[c][node->child[0]];
+				failed_input|=node->lo;
+			}
+			
+			if((split==nclusters) || ((sure[w]>>bit)&1))
+			{
+				tnStack.clear();
+				return false; // Binary vector, or all represented vectors fail
+			}
+			
+			for(u32 half=0;half<2;half++)
+			{
+				size_t top=tnStack.size();
+				tnStack.insert(tnStack.end(), nodes, nodes+nclusters);
+				tnStack[top+split]=tnTrees[split][nodes[split]].child[half];
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Test a candidate network that passed the test vectors on the full output set of the prefix, with the ternary or the
+ * exhaustive second stage if one is in use
+ * @param ninputs Number of inputs
+ * @param nw Kernel view of the candidate
+ * @param failed_input [OUT] Binary input vector for which the network fails
+ * @return true if the network passed the second stage, or if there is none
+ */
+bool BPTester::Data::secondStageTest(u8 ninputs, const KernelNetwork_t &nw, SortWord_t &failed_input)
+{
+	if(!tnTrees.empty())
+		return ternaryTest(ninputs, nw, failed_input);
+	if(!exValid.empty())
+		return exhaustiveTest(ninputs, nw, failed_input);
+	return true;
+}
+
+/**
+ * Run the second stage on a candidate network, and store the failing binary vector in the cache
+ * @param ninputs Number of inputs
+ * @param nw Kernel view of the candidate
+ * @param bpl List of test vectors, starting with the cache of failing binary vectors
+ * @return Index of the failing vector in the cache, or NO_FAILURE
+ */
+size_t BPTester::Data::testSecondStage(u8 ninputs, const KernelNetwork_t &nw, BitParallelList_t &bpl)
+{
+	SortWord_t failed_input;
+	if(secondStageTest(ninputs, nw, failed_input))
+		return NO_FAILURE;
+	return cacheTestVector(bpl, ninputs, failed_input);
+}
+
+/**
+ * Find the last checkpoint that is valid for a candidate network
+ * @param nw Candidate core network
+ * @return Checkpoint number c (state after c*cpInterval core CEs), 0 if no checkpoint can be used
+ */
+size_t BPTester::Data::findCheckpoint(const Network_t &nw) const
+{
+	const size_t chunk=sizeof(uint64_t)/sizeof(Pair_t);
+	size_t l=std::min(nw.size(), cpStates.size()*cpInterval);
+	size_t d=0;
+	
+	// Compare a few CEs at a time, then locate the first difference
+	while(((d+chunk)<=l) && (memcmp(&nw[d], &cpNetwork[d], sizeof(uint64_t))==0))
+		d+=chunk;
+	while((d<l) && (nw[d]==cpNetwork[d]))
+		d++;
+	return (cpInterval>0) ? d/cpInterval : 0;
+}
+
+/**
+ * Reorder the test vectors after a failure, see bumpVectorPosition and bumpPatternPosition
+ * @param bpl List of test vectors
+ * @param ninputs Number of inputs
+ * @param failvector Index of the first failing vector
+ */
+void BPTester::Data::bumpFailure(BitParallelList_t &bpl, u8 ninputs, size_t failvector)
+{
+	if(pmCount>0)
+		bumpPatternPosition(failvector);
+	else
+		bumpVectorPosition(bpl, ninputs, failvector);
+}
+
+/**
+ * Test a single candidate network, resuming from a checkpoint if possible
+ * @param ninputs Number of inputs
+ * @param nw Kernel view of the candidate
+ * @param core Candidate core network, used to look up checkpoints (NULL if the candidate cannot use checkpoints)
+ * @param bpl List of test vectors
+ * @return Index of the first failing vector, or NO_FAILURE
+ */
+size_t BPTester::Data::testCandidate(u8 ninputs, const KernelNetwork_t &nw, const Network_t *core, BitParallelList_t &bpl)
+{
+	size_t failvector;
+	size_t c=core ? findCheckpoint(*core) : 0;
+	
+	if(pmCount>0)
+	{
+		failvector=testPatternMajor(ninputs, nw, NULL);
+	}
+	else if(c>0)
+	{
+		// Leading groups resume from the checkpoint, other groups are tested from scratch
+		failvector=testKernel(ninputs, kernelNetwork(*core, c*cpInterval), cpStates[c-1].data(), cpWords, NULL);
+		if(failvector!=NO_FAILURE)
+		{
+			failvector=cpVector[failvector];
+		}
+		else
+		{
+			failvector=testKernel(ninputs, nw, bpl.data()+cpWords, bpl.size()-cpWords, NULL);
+			if(failvector!=NO_FAILURE)
+				failvector+=cpVector.size();
+		}
+	}
+	else
+	{
+		failvector=testKernel(ninputs, nw, bpl.data(), bpl.size(), NULL);
+	}
+	
+	if(failvector==NO_FAILURE)
+		failvector=testSharedTail(ninputs, nw, bpl, NULL);
+	if(failvector==NO_FAILURE)
+		failvector=testSecondStage(ninputs, nw, bpl);
+	return failvector;
+}
+
+/**
+ * Test a batch of candidate networks
+ * @param ninputs Number of inputs
+ * @param nws Kernel views of the candidates
+ * @param cores Candidate core networks, used to look up checkpoints (NULL if the candidates cannot use checkpoints)
+ * @param count Number of candidates (at most MAXBATCHSIZE)
+ * @param bpl List of test vectors
+ * @param valid [OUT] For each candidate, true if it passed all test vectors
+ */
+void BPTester::Data::testCandidates(u8 ninputs, const KernelNetwork_t nws[], const Network_t *cores, size_t count, BitParallelList_t &bpl, std::vector<bool> &valid)
+{
+	size_t starts[MAXBATCHSIZE]={};
+	size_t failvectors[MAXBATCHSIZE];
+	
+	if((count==1) || (pmCount>0))
+	{
+		// Single candidate, or few test vectors: nothing to gain from sharing loads
+		for(size_t m=0;m<count;m++)
+			failvectors[m]=testCandidate(ninputs, nws[m], cores ? &cores[m] : NULL, bpl);
+	}
+	else
+	{
+		for(size_t m=0;m<count;m++)
+		{
+			starts[m]=0;
+			failvectors[m]=NO_FAILURE;
+			
+			size_t c=cores ? findCheckpoint(cores[m]) : 0;
+			if(c>0)
+			{
+				// Groups covered by checkpoints are tested separately, resuming from the checkpoint
+				failvectors[m]=testKernel(ninputs, kernelNetwork(cores[m], c*cpInterval), cpStates[c-1].data(), cpWords, NULL);
+				if(failvectors[m]!=NO_FAILURE)
+				{
+					failvectors[m]=cpVector[failvectors[m]];
+					starts[m]=bpl.size(); // Not taking part in the batch
+				}
+				else
+				{
+					starts[m]=cpWords;
+				}
+			}
+		}
+		
+		size_t batchfail[MAXBATCHSIZE];
+		batchKernel(nws, starts, count, bpl.data(), bpl.size(), batchfail);
+		if(tailSize>0)
+		{
+			// Candidates that passed the private list go on with the shared tail
+			size_t tailfail[MAXBATCHSIZE];
+			for(size_t m=0;m<count;m++)
+				starts[m]=((failvectors[m]==NO_FAILURE) && (batchfail[m]==NO_FAILURE)) ? 0 : tailSize;
+			batchKernel(nws, starts, count, tailWords, tailSize, tailfail);
+			for(size_t m=0;m<count;m++)
+			{
+				if((starts[m]==0) && (tailfail[m]!=NO_FAILURE))
+					batchfail[m]=tailfail[m]+(bpl.size()/ninputs)*PARWORDSIZE;
+			}
+		}
+		for(size_t m=0;m<count;m++)
+		{
+			if(failvectors[m]==NO_FAILURE)
+				failvectors[m]=batchfail[m];
+			if(failvectors[m]==NO_FAILURE)
+				failvectors[m]=testSecondStage(ninputs, nws[m], bpl);
+		}
+	}
+	
+	// Test vectors are only reordered after all candidates have been tested, all of them need to see the same order
+	valid.resize(count);
+	for(size_t m=0;m<count;m++)
+	{
+		valid[m]=(failvectors[m]==NO_FAILURE);
+		if(!valid[m])
+			bumpFailure(bpl, ninputs, failvectors[m]);
+	}
+}
+
+bool BPTester::Data::testpairsFromPrefixOutput(u8 ninputs, const Network_t &pairs, BitParallelList_t &bpl)
+{
+	size_t failvector=testCandidate(ninputs, kernelNetwork(pairs, 0), &pairs, bpl);
+	if(failvector!=NO_FAILURE)
+	{
+		bumpFailure(bpl, ninputs, failvector);
+		return false;
+	}
+	return true;
+}
+
+void BPTester::Data::testBatchFromPrefixOutput(u8 ninputs, const std::vector<Network_t> &candidates, BitParallelList_t &bpl, std::vector<bool> &valid)
+{
+	KernelNetwork_t nws[MAXBATCHSIZE];
+	for(size_t m=0;m<candidates.size();m++)
+		nws[m]=kernelNetwork(candidates[m], 0);
+	testCandidates(ninputs, nws, candidates.data(), candidates.size(), bpl, valid);
+}
+
+/**
+ * Kernel view of a layered candidate core network
+ * @param layers Layered core network
+ * @param m Index of the scratch buffers holding the flattened network
+ */
+KernelNetwork_t BPTester::Data::layeredKernelNetwork(const LayeredNetwork_t &layers, size_t m)
+{
+	Network_t &ces=layerCEs[m];
+	std::vector<u8> &sizes=layerSizes[m];
+	ces.clear();
+	sizes.clear();
+	for(size_t l=0;l<layers.size();l++)
+	{
+		ces.insert(ces.end(), layers[l].ces.begin(), layers[l].ces.end());
+		sizes.push_back(layers[l].ces.size());
+	}
+	
+	KernelNetwork_t nw=kernelNetwork(ces, 0);
+	nw.layersizes=sizes.data();
+	nw.nlayers=sizes.size();
+	return nw;
+}
+
+void BPTester::Data::testLayerBatchFromPrefixOutput(u8 ninputs, const std::vector<LayeredNetwork_t> &candidates, BitParallelList_t &bpl, std::vector<bool> &valid)
+{
+	KernelNetwork_t nws[MAXBATCHSIZE];
+	for(size_t m=0;m<candidates.size();m++)
+		nws[m]=layeredKernelNetwork(candidates[m], m);
+	testCandidates(ninputs, nws, NULL, candidates.size(), bpl, valid);
+}
+
+bool BPTester::Data::computeActivity(u8 ninputs, const Network_t &core, const BitParallelList_t &bpl, std::vector<uint64_t> &activity)
+{
+	KernelNetwork_t nw=kernelNetwork(core, 0);
+	activity.assign(core.size(), 0);
+	if(tailSize>0)
+		activityKernel(ninputs, nw, tailWords, tailSize, activity.data()); // The private list only holds copies of shared vectors
+	else
+		activityKernel(ninputs, nw, bpl.data(), bpl.size(), activity.data());
+	
+	// With a second stage, the test vectors are only part of the output set of the prefix
+	return tnTrees.empty() && exValid.empty();
+}
+
+bool BPTester::Data::testInitialPairsFromPrefixOutput(u8 ninputs, const Network_t &pairs, const BitParallelList_t &bpl, SortWord_t &failed_output_pattern)
+{
+	KernelNetwork_t nw=kernelNetwork(pairs, 0);
+	failed_output_pattern=0;
+	if(pmCount>0)
+		return testPatternMajor(ninputs, nw, &failed_output_pattern)==NO_FAILURE;
+	if(testKernel(ninputs, nw, bpl.data(), bpl.size(), &failed_output_pattern)!=NO_FAILURE)
+		return false;
+	if(testSharedTail(ninputs, nw, bpl, &failed_output_pattern)!=NO_FAILURE)
+		return false;
+	
+	SortWord_t failed_input;
+	if(secondStageTest(ninputs, nw, failed_input))
+		return true;
+	
+	// Send the failing input through the network to obtain its output
+	SortWord_t w=failed_input;
+	for(size_t n=0;n<pairs.size();n++)
+		w=applyToPattern(w, ninputs, pairs[n]);
+	for(size_t n=0;n<fixedPostfix.size();n++)
+	{
+		SortWord_t swap=((w>>fixedPostfix[n].lo)&~(w>>fixedPostfix[n].hi))&1;
+		w^=(swap<<fixedPostfix[n].lo)|(swap<<fixedPostfix[n].hi);
+	}
+	failed_output_pattern=w;
+	return false;
+}
+
+BPTester::BPTester()
+{
+	data=new Data;
+}
+
+BPTester::~BPTester()
+{
+	delete data;
+}
+
+u32 BPTester::selectTestKernel(u8 ninputs, u32 requested_bits)
+{
+	return data->selectTestKernel(ninputs, requested_bits);
+}
+
+u32 BPTester::testKernelLanes() const
+{
+	return data->kernelLanes;
+}
+
+void BPTester::setNetworkExpansion(bool symmetric, const Network_t &postfix)
+{
+	data->setNetworkExpansion(symmetric, postfix);
+}
+
+void BPTester::configurePatternMajor(u32 threshold)
+{
+	data->configurePatternMajor(threshold);
+}
+
+bool BPTester::setTestVectors(u8 ninputs, const BitParallelList_t &bpl)
+{
+	return data->setTestVectors(ninputs, bpl);
+}
+
+bool BPTester::shareTestVectors(u8 ninputs, const BitParallelList_t &shared, BitParallelList_t &bpl)
+{
+	return data->shareTestVectors(ninputs, shared, bpl);
+}
+
+void BPTester::setTernaryClusters(const std::vector<SinglePatternList_t> &clusters, u32 cachevectors)
+{
+	data->setTernaryClusters(clusters, cachevectors);
+}
+
+void BPTester::setExhaustiveClusters(u8 ninputs, const std::vector<SinglePatternList_t> &clusters, u32 chunkvectors, u32 cachevectors)
+{
+	data->setExhaustiveClusters(ninputs, clusters, chunkvectors, cachevectors);
+}
+
+void BPTester::refreshTestVectors(u8 ninputs, const SinglePatternList_t &sample, BitParallelList_t &bpl)
+{
+	data->refreshTestVectors(ninputs, sample, bpl);
+}
+
+void BPTester::configureCheckpoints(u32 interval, u32 groups)
+{
+	data->configureCheckpoints(interval, groups);
+}
+
+void BPTester::setReferenceNetwork(u8 ninputs, const Network_t &nw, const BitParallelList_t &bpl)
+{
+	data->setReferenceNetwork(ninputs, nw, bpl);
+}
+
+void BPTester::clearReferenceNetwork()
+{
+	data->clearReferenceNetwork();
+}
+
+bool BPTester::testpairsFromPrefixOutput(u8 ninputs, const Network_t &pairs, BitParallelList_t &bpl)
+{
+	return data->testpairsFromPrefixOutput(ninputs, pairs, bpl);
+}
+
+void BPTester::testBatchFromPrefixOutput(u8 ninputs, const std::vector<Network_t> &candidates, BitParallelList_t &bpl, std::vector<bool> &valid)
+{
+	data->testBatchFromPrefixOutput(ninputs, candidates, bpl, valid);
+}
+
+void BPTester::testLayerBatchFromPrefixOutput(u8 ninputs, const std::vector<LayeredNetwork_t> &candidates, BitParallelList_t &bpl, std::vector<bool> &valid)
+{
+	data->testLayerBatchFromPrefixOutput(ninputs, candidates, bpl, valid);
+}
+
+bool BPTester::computeActivity(u8 ninputs, const Network_t &core, const BitParallelList_t &bpl, std::vector<uint64_t> &activity)
+{
+	return data->computeActivity(ninputs, core, bpl, activity);
+}
+
+bool BPTester::testInitialPairsFromPrefixOutput(u8 ninputs, const Network_t &pairs, const BitParallelList_t &bpl, SortWord_t &failed_output_pattern)
+{
+	return data->testInitialPairsFromPrefixOutput(ninputs, pairs, bpl, failed_output_pattern);
+}
@@ -0,0 +1,215 @@
+/**
+ * @file bp_tester.h
+ * @brief Bit-parallel test kernels for candidate sorting networks
+ * @author Bert Dobbelaere bert.o.dobbelaere[at]telenet[dot]be
+ *
+ * Copyright (c) 2022 Bert Dobbelaere
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BP_TESTER_H_
+#define _BP_TESTER_H_
+
+#include "htypes.h"
+
+#define MAXBATCHSIZE (64) ///< Maximum number of candidate networks tested together
+
+/**
+ * Tests candidate networks on the bit-parallel output patterns of a prefix. Holds the selected kernel, the test vectors
+ * with their order, the checkpoints and the second stages. Each search (or thread) needs a tester of its own.
+ */
+class BPTester
+{
+	public:
+		/**
+		 * Object init. A test kernel must be selected before any test vectors are set.
+		 */
+		BPTester();
+		
+		/**
+		 * Selects the test kernel. Wider kernels process more test vectors per CE
+		 * and are only used when the CPU supports the required instruction set.
+		 * Kernels are specialized for each number of inputs, so this must be called once the number of inputs is known.
+		 * @param ninputs Number of inputs (2..NMAX)
+		 * @param requested_bits 0 to pick the widest kernel supported by the CPU, or 64, 256 or 512
+		 * @return Number of BPWord_t lanes per line in a group of test vectors (1, 4 or 8)
+		 */
+		u32 selectTestKernel(u8 ninputs, u32 requested_bits);
+		
+		/**
+		 * Number of BPWord_t lanes per line used by the selected test kernel
+		 */
+		u32 testKernelLanes() const;
+		
+		/**
+		 * Define how candidate networks are expanded by the testers. Candidates are passed as core networks,
+		 * the testers apply the mirror image of each core CE (for symmetric networks) and the postfix on the fly.
+		 * @param symmetric Apply the mirror image of each core CE, unless the CE maps on itself
+		 * @param postfix Postfix network appended to each candidate
+		 */
+		void setNetworkExpansion(bool symmetric, const Network_t &postfix);
+		
+		/**
+		 * Configure the use of the pattern-major kernel, which stores each test vector as a whole SortWord_t
+		 * and is more efficient than the line-major kernels for small sets of test vectors.
+		 * @param threshold Maximum number of test vectors for which the pattern-major kernel is used (0=never)
+		 */
+		void configurePatternMajor(u32 threshold);
+		
+		/**
+		 * Announce a new list of test vectors. Forgets the reference network, and selects
+		 * the pattern-major kernel if the number of test vectors is below the configured threshold.
+		 * @param ninputs Number of inputs
+		 * @param bpl List of test vectors
+		 * @return true if the pattern-major kernel is used for these test vectors
+		 */
+		bool setTestVectors(u8 ninputs, const BitParallelList_t &bpl);
+		
+		/**
+		 * Announce a list of test vectors that is shared with other testers, instead of setTestVectors. This tester
+		 * gets a private copy of the leading groups of the list, which it reorders like a regular list and tests first.
+		 * The shared list is then tested in place, without being modified.
+		 * @param ninputs Number of inputs
+		 * @param shared List of test vectors, which must not change while in use
+		 * @param bpl [OUT] Private part of the list of test vectors, to be passed to the testers
+		 * @return true if the pattern-major kernel is used for these test vectors
+		 */
+		bool shareTestVectors(u8 ninputs, const BitParallelList_t &shared, BitParallelList_t &bpl);
+		
+		/**
+		 * Switch to ternary testing for the current prefix: candidates are tested on the full output set of the prefix, by sending
+		 * ternary (0/1/X) vectors through the network that each represent many binary vectors. Binary vectors that made candidates
+		 * fail are collected in the test vector list, and tested first. Cleared by setTestVectors.
+		 * @param clusters Output pattern lists of the line clusters of the prefix, see computePrefixClusters
+		 * @param cachevectors Maximum number of failing binary vectors kept in the test vector list
+		 */
+		void setTernaryClusters(const std::vector<SinglePatternList_t> &clusters, u32 cachevectors);
+		
+		/**
+		 * Switch to two-stage testing for the current prefix: the test vector list only holds a sample of the output set of the prefix
+		 * (see refreshTestVectors). Candidates that pass it are tested on the full output set, which is enumerated in chunks from the
+		 * cluster pattern lists. Binary vectors that made candidates fail in the second stage are kept at the front of the test
+		 * vector list. Cleared by setTestVectors.
+		 * @param ninputs Number of inputs
+		 * @param clusters Output pattern lists of the line clusters of the prefix, see computePrefixClusters
+		 * @param chunkvectors Maximum number of output patterns tested at once in the second stage (unless a single cluster has more)
+		 * @param cachevectors Maximum number of failing binary vectors kept in the test vector list
+		 */
+		void setExhaustiveClusters(u8 ninputs, const std::vector<SinglePatternList_t> &clusters, u32 chunkvectors, u32 cachevectors);
+		
+		/**
+		 * Replace the sample of test vectors used in two-stage or ternary testing, keeping the cached failing vectors
+		 * @param ninputs Number of inputs
+		 * @param sample New sample of output patterns of the prefix
+		 * @param bpl [IN/OUT] List of test vectors
+		 */
+		void refreshTestVectors(u8 ninputs, const SinglePatternList_t &sample, BitParallelList_t &bpl);
+		
+		/**
+		 * Configure checkpoints of the line states of the leading test vector groups.
+		 * Candidates that have their first CEs in common with the reference network resume testing of these groups
+		 * from the last checkpoint before the first difference.
+		 * @param interval Number of core CEs between checkpoints (0 disables checkpoints)
+		 * @param groups Number of leading test vector groups covered by the checkpoints
+		 */
+		void configureCheckpoints(u32 interval, u32 groups);
+		
+		/**
+		 * Set the reference network for the checkpoints, normally the last accepted network, and compute its checkpoints.
+		 * Must be called again whenever the test vectors are replaced. No checkpoints are used with the pattern-major kernel.
+		 * @param ninputs Number of inputs
+		 * @param nw Reference core network
+		 * @param bpl List of test vectors
+		 */
+		void setReferenceNetwork(u8 ninputs, const Network_t &nw, const BitParallelList_t &bpl);
+		
+		/**
+		 * Forget the reference network and its checkpoints
+		 */
+		void clearReferenceNetwork();
+		
+		/**
+		 * Test a candidate network complementing the prefix.
+		 * This function is called during the regular evolution loop and attempts to
+		 * optimize the future order of test vectors in the background
+		 * @param ninputs Number of inputs
+		 * @param pairs Candidate core network
+		 * @param bpl List of test vectors matching the prefix
+		 * @return true if prefix, expanded pairs and postfix form a valid sorter
+		 */
+		bool testpairsFromPrefixOutput(u8 ninputs, const Network_t &pairs, BitParallelList_t &bpl);
+		
+		/**
+		 * Test a batch of candidate networks complementing the prefix.
+		 * Each group of test vectors is sent through all candidates that did not fail yet before moving on to the next group.
+		 * Like testpairsFromPrefixOutput, it optimizes the future order of test vectors in the background.
+		 * @param ninputs Number of inputs
+		 * @param candidates Candidate core networks (at most MAXBATCHSIZE)
+		 * @param bpl List of test vectors matching the prefix
+		 * @param valid [OUT] For each candidate, true if prefix, expanded candidate and postfix form a valid sorter
+		 */
+		void testBatchFromPrefixOutput(u8 ninputs, const std::vector<Network_t> &candidates, BitParallelList_t &bpl, std::vector<bool> &valid);
+		
+		/**
+		 * Test a batch of layered candidate networks complementing the prefix, see testBatchFromPrefixOutput.
+		 * The CEs of a layer are applied in parallel. Checkpoints are not used for layered candidates.
+		 * @param ninputs Number of inputs
+		 * @param candidates Candidate layered core networks (at most MAXBATCHSIZE)
+		 * @param bpl List of test vectors matching the prefix
+		 * @param valid [OUT] For each candidate, true if prefix, expanded candidate and postfix form a valid sorter
+		 */
+		void testLayerBatchFromPrefixOutput(u8 ninputs, const std::vector<LayeredNetwork_t> &candidates, BitParallelList_t &bpl, std::vector<bool> &valid);
+		
+		/**
+		 * Count for each CE of a core network on how many test vectors it swaps its inputs. Counts include the mirror image of the CE
+		 * for symmetric networks. A CE that never swaps can be removed without changing the outputs of the network for the test vectors.
+		 * @param ninputs Number of inputs
+		 * @param core Core network
+		 * @param bpl List of test vectors
+		 * @param activity [OUT] Number of swaps of each CE of the core network
+		 * @return true if the test vectors cover the full output set of the prefix, i.e. the counts are exact
+		 */
+		bool computeActivity(u8 ninputs, const Network_t &core, const BitParallelList_t &bpl, std::vector<uint64_t> &activity);
+		
+		/**
+		 * Test a candidate network complementing the prefix.
+		 * This function is called during the search for an initial sorter
+		 * @param ninputs Number of inputs
+		 * @param pairs Candidate core network
+		 * @param bpl List of test vectors matching the prefix
+		 * @param failed_output_pattern First unsorted output pattern detected. Used to determine candidate elements to be appended.
+		 * @return true if prefix, expanded pairs and postfix form a valid sorter
+		 */
+		bool testInitialPairsFromPrefixOutput(u8 ninputs, const Network_t &pairs, const BitParallelList_t &bpl, SortWord_t &failed_output_pattern);
+		
+		/**
+		 * Clean up
+		 */
+		~BPTester();
+	private:
+		BPTester(const BPTester &);            ///< Not copyable
+		BPTester &operator=(const BPTester &); ///< Not copyable
+		class Data;
+		Data *data;
+};
+
+#endif // _BP_TESTER_H_
@@ -0,0 +1,324 @@
+/**
+ * @file control_socket.cpp
+ * @brief UNIX-domain control socket to observe and steer running searches
+ * @author Bert Dobbelaere bert.o.dobbelaere[at]telenet[dot]be
+ *
+ * Copyright (c) 2022 Bert Dobbelaere
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "control_socket.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+
+using std::string;
+
+typedef std::function<string(SearchContext &)> ControlRequest_t; ///< Command for one search, returns the reply of the search
+
+/**
+ * Control server internal kitchen class
+ */
+class ControlServer::Data {
+	public:
+		void serve();
+		void handleClient(int fd);
+		string execute(const string &line);
+		string runOnSearches(const ControlRequest_t &request);
+		
+		int listenfd=-1;                ///< Listening socket, -1 if not started
+		std::atomic<int> clientfd{-1};  ///< Connection of the current client, -1 if none
+		string path;                    ///< Path of the socket
+		std::thread thread;             ///< Thread serving the clients
+		std::atomic<bool> stop{false};  ///< Serving has to stop
+		SearchArchive_t *archive=NULL;  ///< Archive of the searches
+		
+		std::mutex lock;                ///< Protects the members below
+		std::condition_variable done;   ///< Signals that all searches executed the request
+		ControlRequest_t request;       ///< Request being executed, empty if none
+		std::vector<bool> pending;      ///< Per search: the request is still to be executed
+		std::vector<string> replies;    ///< Per search: reply to the request
+		u32 busy=0;                     ///< Number of searches that did not execute the request
+};
+
+/**
+ * Execute a request by all searches, and wait for their replies
+ * @param request Request
+ * @return Replies of all searches, one line each
+ */
+string ControlServer::Data::runOnSearches(const ControlRequest_t &request)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	this->request=request;
+	pending.assign(pending.size(), true);
+	busy=pending.size();
+	done.wait(guard, [&]{ return busy==0; });
+	this->request=nullptr;
+	
+	string text;
+	for(size_t k=0;k<replies.size();k++)
+	{
+		text+="search "+std::to_string(k)+": "+replies[k]+"\n";
+	}
+	return text;
+}
+
+/**
+ * Execute a command line
+ * @param line Command line, without line end
+ * @return Reply
+ */
+string ControlServer::Data::execute(const string &line)
+{
+	string cmd=line.substr(0, line.find_first_of(" \t"));
+	size_t argstart=line.find_first_not_of(" \t", cmd.size());
+	string arg=(argstart==string::npos) ? "" : line.substr(argstart);
+	
+	if(cmd=="help")
+	{
+		return "stats\nset <Key>=<value>   (EscapeRate, MaxMutations or mutation weights)\ninject <pairs>\nrestart\nquit\nok\n";
+	}
+	if(cmd=="stats")
+	{
+		string text=runOnSearches([](SearchContext &search)
+		{
+			SearchStats_t s=search.statistics();
+			char buf[200];
+			snprintf(buf, sizeof(buf), "candidates %lu accepted %lu restarts %lu prefix %lu network %lu pairs depth %u",
+				s.candidates, s.accepted, s.restarts, s.prefixsize, s.networksize, s.depth);
+			return string(buf);
+		});
+		std::lock_guard<std::mutex> guard(archive->lock);
+		return text+"Most performant: "+archive->conv_hull.toString()+"\nok\n";
+	}
+	if(cmd=="set")
+	{
+		std::shared_ptr<ConfigParser> cp=std::make_shared<ConfigParser>(); // ConfigParser is not copyable
+		string key=arg.substr(0, arg.find('='));
+		key=key.substr(0, key.find_last_not_of(" \t")+1);
+		bool known=(key=="EscapeRate") || (key=="MaxMutations");
+		for(u32 n=0;n<NMUTATIONTYPES;n++)
+		{
+			known=known || (key==mutationWeightKeys[n]);
+		}
+		if(!known)
+			return "error: unknown setting '"+key+"'\n";
+		if(!cp->parseSetting(arg))
+			return "error: expected <Key>=<value>\n";
+		return runOnSearches([cp](SearchContext &search)
+		{
+			SearchConfig_t c=search.config();
+			if(!readSearchTuning(*cp, c) || !search.retune(c))
+				return string("not changed, no mutation types would be selected");
+			return string("changed");
+		})+"ok\n";
+	}
+	if(cmd=="inject")
+	{
+		ConfigParser cp;
+		if(!cp.parseSetting("InitialNetwork="+arg) || cp.getNetwork("InitialNetwork").empty())
+			return "error: expected a list of pairs\n";
+		Network_t nw=cp.getNetwork("InitialNetwork");
+		return runOnSearches([nw](SearchContext &search)
+		{
+			return string(search.injectNetwork(nw) ? "adopted" : "rejected, not a sorter with the prefix of this search");
+		})+"ok\n";
+	}
+	if(cmd=="restart")
+	{
+		return runOnSearches([](SearchContext &search)
+		{
+			search.requestRestart();
+			return string("restarting");
+		})+"ok\n";
+	}
+	return "error: unknown command '"+cmd+"', try help\n";
+}
+
+/**
+ * Read and execute the commands of a client until it disconnects
+ * @param fd Connection
+ */
+void ControlServer::Data::handleClient(int fd)
+{
+	string buffer;
+	char chunk[4096];
+	for(;;)
+	{
+		size_t eol;
+		while((eol=buffer.find('\n'))!=string::npos)
+		{
+			string line=buffer.substr(0, eol);
+			buffer.erase(0, eol+1);
+			size_t last=line.find_last_not_of(" \t\r");
+			line=(last==string::npos) ? "" : line.substr(0, last+1);
+			if(line.empty())
+				continue;
+			if(line=="quit")
+				return;
+			string reply=execute(line);
+			if(send(fd, reply.data(), reply.size(), MSG_NOSIGNAL)!=(ssize_t)reply.size())
+				return;
+		}
+		ssize_t n=recv(fd, chunk, sizeof(chunk), 0);
+		if((n<0) && (errno==EINTR))
+			continue;
+		if(n<=0)
+			return;
+		buffer.append(chunk, n);
+	}
+}
+
+/**
+ * Server thread: accept clients one at a time, until stopped
+ */
+void ControlServer::Data::serve()
+{
+	while(!stop)
+	{
+		int fd=accept(listenfd, NULL, NULL);
+		if(fd<0)
+		{
+			if((errno==EINTR) || (errno==ECONNABORTED))
+				continue;
+			return;
+		}
+		clientfd=fd;
+		if(!stop)
+			handleClient(fd);
+		clientfd=-1;
+		close(fd);
+	}
+}
+
+ControlServer::ControlServer()
+{
+	data=new Data;
+}
+
+bool ControlServer::start(const string &path, u32 nsearches, SearchArchive_t *archive)
+{
+	sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family=AF_UNIX;
+	if(path.empty() || (path.size()>=sizeof(addr.sun_path)))
+	{
+		printf("Error: invalid control socket path '%s'\n", path.c_str());
+		return false;
+	}
+	strcpy(addr.sun_path, path.c_str());
+	
+	struct stat st;
+	if(lstat(path.c_str(), &st)==0)
+	{
+		if(!S_ISSOCK(st.st_mode))
+		{
+			printf("Error: control socket path '%s' exists and is not a socket\n", path.c_str());
+			return false;
+		}
+		int probe=socket(AF_UNIX, SOCK_STREAM, 0);
+		if(probe<0)
+		{
+			perror("Control socket");
+			return false;
+		}
+		int rc=connect(probe, (const sockaddr *)&addr, sizeof(addr));
+		int err=errno;
+		close(probe);
+		if(rc==0)
+		{
+			printf("Error: control socket '%s' already in use\n", path.c_str());
+			return false;
+		}
+		if(err!=ECONNREFUSED)
+		{
+			printf("Error: control socket '%s': %s\n", path.c_str(), strerror(err));
+			return false;
+		}
+		unlink(path.c_str()); // Left behind by an earlier run, nobody listens on it
+	}
+	
+	int fd=socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd<0)
+	{
+		perror("Control socket");
+		return false;
+	}
+	if((bind(fd, (const sockaddr *)&addr, sizeof(addr))!=0) || (listen(fd, 4)!=0))
+	{
+		perror("Control socket");
+		close(fd);
+		return false;
+	}
+	
+	data->listenfd=fd;
+	data->path=path;
+	data->archive=archive;
+	data->pending.assign(nsearches, false);
+	data->replies.assign(nsearches, "");
+	data->thread=std::thread(&ControlServer::Data::serve, data);
+	return true;
+}
+
+void ControlServer::service(u32 index, SearchContext &search)
+{
+	ControlRequest_t request;
+	{
+		std::lock_guard<std::mutex> guard(data->lock);
+		if(!data->request || !data->pending[index])
+			return;
+		request=data->request;
+	}
+	string reply=request(search);
+	std::lock_guard<std::mutex> guard(data->lock);
+	data->replies[index]=reply;
+	data->pending[index]=false;
+	if(--data->busy==0)
+		data->done.notify_one();
+}
+
+ControlServer::~ControlServer()
+{
+	if(data->listenfd>=0)
+	{
+		data->stop=true;
+		shutdown(data->listenfd, SHUT_RDWR); // Wakes up accept
+		int client=data->clientfd;
+		if(client>=0)
+			shutdown(client, SHUT_RDWR);
+		data->thread.join();
+		close(data->listenfd);
+		unlink(data->path.c_str());
+	}
+	delete data;
+}
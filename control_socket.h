@@ -0,0 +1,79 @@
+/**
+ * @file control_socket.h
+ * @brief UNIX-domain control socket to observe and steer running searches
+ * @author Bert Dobbelaere bert.o.dobbelaere[at]telenet[dot]be
+ *
+ * Copyright (c) 2022 Bert Dobbelaere
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _CONTROL_SOCKET_H_
+#define _CONTROL_SOCKET_H_
+
+#include "search_context.h"
+#include <string>
+
+/**
+ * Server of a UNIX-domain control socket. Clients send text commands, one per line, and get a text reply ending with a line
+ * "ok" or "error: ...". Commands:
+ *   stats             Counters of each search and the best performing (size,depth) combinations
+ *   set <Key>=<value> Change EscapeRate, MaxMutations or a mutation weight of all searches, keys as in the config file
+ *   inject <pairs>    Offer a core network (as InitialNetwork) to all searches, each adopts it if it is a valid sorter with its prefix
+ *   restart           Restart all searches
+ *   help              List the commands
+ *   quit              Close the connection
+ * Commands that act on searches are executed by the threads running them, between steps (see service).
+ */
+class ControlServer
+{
+	public:
+		ControlServer();
+		
+		/**
+		 * Create the socket and serve clients in a thread of its own, one client at a time
+		 * @param path Path of the socket. A socket left behind by an earlier run is replaced, a socket on which another run still
+		 *             listens is not. Any other file at that path is left alone.
+		 * @param nsearches Number of searches, each one has to call service regularly
+		 * @param archive Archive of best performing networks of the searches
+		 * @return false if the socket could not be created, e.g. because the path is in use
+		 */
+		bool start(const std::string &path, u32 nsearches, SearchArchive_t *archive);
+		
+		/**
+		 * Execute the pending command for a search. To be called by the thread running the search, between steps.
+		 * @param index Index of the search (0..nsearches-1)
+		 * @param search The search
+		 */
+		void service(u32 index, SearchContext &search);
+		
+		/**
+		 * Clean up, stops serving and removes the socket
+		 */
+		~ControlServer();
+	private:
+		ControlServer(const ControlServer &);            ///< Not copyable
+		ControlServer &operator=(const ControlServer &); ///< Not copyable
+		class Data;
+		Data *data;
+};
+
+#endif // _CONTROL_SOCKET_H_
@@ -0,0 +1,312 @@
+/**
+ * @file farm.cpp
+ * @brief Local farm of SorterHunter worker processes reporting to one parent (--farm)
+ * @author Bert Dobbelaere bert.o.dobbelaere[at]telenet[dot]be
+ *
+ * Copyright (c) 2022 Bert Dobbelaere
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "farm.h"
+#include "thread_affinity.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <ctime>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#define FARM_MAGIC 0x57484e53u ///< Start of every report frame
+
+/**
+ * Header of a report frame sent by a worker, followed by npairs (lo,hi) byte pairs
+ */
+struct FarmFrame_t {
+	u32 magic;      ///< FARM_MAGIC
+	u32 npairs;     ///< Size of the network, prefix included
+	u32 depth;      ///< Depth of the network
+	u32 prefixsize; ///< Size of the prefix
+};
+
+/**
+ * Worker process as seen by the parent
+ */
+struct FarmProcess_t {
+	pid_t pid=-1;             ///< Process id, -1 if not running
+	int fd=-1;                ///< Read end of the report pipe
+	u32 starts=0;             ///< Number of times the worker was started
+	time_t started=0;         ///< Time of the last start
+	std::vector<u8> buffer;   ///< Received bytes that do not form a complete frame yet
+};
+
+/**
+ * Number of threads of one worker: the islands and their speculation workers
+ * @param cfg Settings
+ * @return Number of threads
+ */
+static u32 workerThreads(const SearchConfig_t &cfg)
+{
+	u32 perisland=(cfg.SpeculativeThreads>1) ? (1+cfg.SpeculativeThreads) : 1;
+	return std::max(cfg.Threads,1u)*perisland;
+}
+
+/**
+ * Write a buffer completely
+ * @param fd File descriptor
+ * @param data Data to write
+ * @param size Number of bytes
+ * @return false if the write failed
+ */
+static bool writeAll(int fd, const u8 *data, size_t size)
+{
+	while(size>0)
+	{
+		ssize_t n=write(fd, data, size);
+		if(n<0)
+		{
+			if(errno==EINTR)
+				continue;
+			return false;
+		}
+		data+=n;
+		size-=n;
+	}
+	return true;
+}
+
+/**
+ * Worker process: run the search and send the improved networks to the parent. Never returns.
+ * @param cfg Settings of the farm
+ * @param index Worker index
+ * @param procs All workers, the pipes of the others are closed
+ * @param fd Write end of the report pipe
+ * @param worker Search to run
+ */
+static void runWorker(const SearchConfig_t &cfg, u32 index, const std::vector<FarmProcess_t> &procs, int fd, FarmWorker_t worker)
+{
+#ifdef __linux__
+	prctl(PR_SET_PDEATHSIG, SIGTERM); // Don't outlive the parent
+#endif
+	signal(SIGPIPE, SIG_DFL);
+	for(size_t k=0;k<procs.size();k++)
+	{
+		if(procs[k].fd>=0)
+			close(procs[k].fd);
+	}
+	
+	SearchConfig_t wcfg=cfg;
+	wcfg.ThreadAffinity=true;
+	setNextCpu(index*workerThreads(cfg));
+	if(wcfg.RandomSeed!=0)
+	{
+		// A restarted worker continues with a fresh seed
+		wcfg.RandomSeed+=(uint64_t)procs[index].starts*procs.size()+index;
+	}
+	if(!wcfg.ControlSocket.empty())
+	{
+		wcfg.ControlSocket+="."+std::to_string(index); // One socket per worker
+	}
+	if(wcfg.Verbosity < 3)
+	{
+		wcfg.Verbosity=0; // The parent reports, only debug output of the workers is shown
+	}
+	
+	SearchArchive_t archive;
+	archive.report=[fd](const Network_t &nw, u32 depth, size_t prefixsize)
+	{
+		FarmFrame_t frame={FARM_MAGIC, (u32)nw.size(), depth, (u32)prefixsize};
+		std::vector<u8> msg(sizeof(frame)+2*nw.size());
+		memcpy(msg.data(), &frame, sizeof(frame));
+		for(size_t k=0;k<nw.size();k++)
+		{
+			msg[sizeof(frame)+2*k]=nw[k].lo;
+			msg[sizeof(frame)+2*k+1]=nw[k].hi;
+		}
+		if(!writeAll(fd, msg.data(), msg.size()))
+		{
+			_exit(0); // Parent is gone
+		}
+	};
+	int rc=worker(wcfg, archive);
+	fflush(stdout);
+	_exit(rc);
+}
+
+/**
+ * Start (or restart) a worker process
+ * @param cfg Settings of the farm
+ * @param index Worker index
+ * @param procs All workers
+ * @param worker Search to run
+ * @return false if the process could not be created
+ */
+static bool startWorker(const SearchConfig_t &cfg, u32 index, std::vector<FarmProcess_t> &procs, FarmWorker_t worker)
+{
+	int fds[2];
+	if(pipe(fds)!=0)
+	{
+		perror("pipe");
+		return false;
+	}
+	fflush(stdout); // Don't let the child inherit pending output
+	pid_t pid=fork();
+	if(pid<0)
+	{
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+	if(pid==0)
+	{
+		close(fds[0]);
+		runWorker(cfg, index, procs, fds[1], worker);
+	}
+	close(fds[1]);
+	FarmProcess_t &p=procs[index];
+	p.pid=pid;
+	p.fd=fds[0];
+	p.starts++;
+	p.started=time(NULL);
+	p.buffer.clear();
+	return true;
+}
+
+/**
+ * Handle the complete frames received from a worker
+ * @param cfg Settings of the farm
+ * @param p Worker
+ * @param conv_hull Best performing combinations of all workers
+ * @return false if the data is not a valid stream of frames
+ */
+static bool handleFrames(const SearchConfig_t &cfg, FarmProcess_t &p, OCH_t &conv_hull)
+{
+	size_t pos=0;
+	while(p.buffer.size()-pos>=sizeof(FarmFrame_t))
+	{
+		FarmFrame_t frame;
+		memcpy(&frame, p.buffer.data()+pos, sizeof(frame));
+		if((frame.magic!=FARM_MAGIC) || (frame.npairs>NMAX*NMAX))
+			return false;
+		size_t size=sizeof(frame)+2*(size_t)frame.npairs;
+		if(p.buffer.size()-pos<size)
+			break;
+		
+		Network_t nw(frame.npairs);
+		const u8 *src=p.buffer.data()+pos+sizeof(frame);
+		for(u32 k=0;k<frame.npairs;k++)
+		{
+			nw[k].lo=src[2*k];
+			nw[k].hi=src[2*k+1];
+			if((nw[k].lo>=nw[k].hi) || (nw[k].hi>=cfg.N))
+				return false;
+		}
+		if(conv_hull.improved(nw.size(), frame.depth))
+		{
+			printNetworkReport(cfg, nw, frame.depth, frame.prefixsize, conv_hull);
+			fflush(stdout);
+		}
+		pos+=size;
+	}
+	p.buffer.erase(p.buffer.begin(), p.buffer.begin()+pos);
+	return true;
+}
+
+int runFarm(const SearchConfig_t &cfg, u32 nworkers, FarmWorker_t worker)
+{
+	std::vector<FarmProcess_t> procs(nworkers);
+	OCH_t conv_hull;
+	
+	signal(SIGPIPE, SIG_IGN); // A dying worker must not take the parent with it (workers restore the default)
+	if(cfg.Verbosity > 0)
+	{
+		printf("Farm of %u workers, %u thread(s) each\n", nworkers, workerThreads(cfg));
+	}
+	for(u32 k=0;k<nworkers;k++)
+	{
+		if(!startWorker(cfg, k, procs, worker))
+			return -1;
+	}
+	
+	std::vector<pollfd> fds(nworkers);
+	std::vector<u8> chunk(65536);
+	for(;;)
+	{
+		for(u32 k=0;k<nworkers;k++)
+		{
+			fds[k].fd=procs[k].fd;
+			fds[k].events=POLLIN;
+			fds[k].revents=0;
+		}
+		if(poll(fds.data(), nworkers, -1)<0)
+		{
+			if(errno==EINTR)
+				continue;
+			perror("poll");
+			return -1;
+		}
+		
+		for(u32 k=0;k<nworkers;k++)
+		{
+			if(!fds[k].revents)
+				continue;
+			FarmProcess_t &p=procs[k];
+			ssize_t n=read(p.fd, chunk.data(), chunk.size());
+			if((n<0) && (errno==EINTR))
+				continue;
+			if(n>0)
+			{
+				p.buffer.insert(p.buffer.end(), chunk.begin(), chunk.begin()+n);
+				if(handleFrames(cfg, p, conv_hull))
+					continue;
+				printf("Error: invalid report from farm worker %u, restarting it\n", k);
+				kill(p.pid, SIGKILL);
+			}
+			
+			/* End of the stream: the worker died */
+			int status=0;
+			close(p.fd);
+			p.fd=-1;
+			waitpid(p.pid, &status, 0);
+			if(cfg.Verbosity > 0)
+			{
+				if(WIFSIGNALED(status))
+					printf("Farm worker %u (pid %d) killed by signal %d, restarting it\n", k, (int)p.pid, WTERMSIG(status));
+				else
+					printf("Farm worker %u (pid %d) exited with code %d, restarting it\n", k, (int)p.pid, WEXITSTATUS(status));
+			}
+			if(time(NULL)-p.started<2)
+			{
+				sleep(1); // Don't spin when a worker dies right away
+			}
+			if(!startWorker(cfg, k, procs, worker))
+				return -1;
+		}
+	}
+}
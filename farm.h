@@ -0,0 +1,53 @@
+/**
+ * @file farm.h
+ * @brief Local farm of SorterHunter worker processes reporting to one parent (--farm)
+ * @author Bert Dobbelaere bert.o.dobbelaere[at]telenet[dot]be
+ *
+ * Copyright (c) 2022 Bert Dobbelaere
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _FARM_H_
+#define _FARM_H_
+
+#include "search_context.h"
+
+/**
+ * Search run by a farm worker process. Improved networks are passed to archive.report, which sends them to the parent.
+ * @param cfg Settings of the worker
+ * @param archive Archive to be used by the searches of the worker
+ * @return Exit code of the worker
+ */
+typedef int (*FarmWorker_t)(const SearchConfig_t &cfg, SearchArchive_t &archive);
+
+/**
+ * Run a farm of worker processes on this machine, and print the improved networks of all of them. Each worker gets a disjoint
+ * set of CPUs (ThreadAffinity) and its own seeds, and reports over a pipe. Workers that die are restarted.
+ * Must be called before any thread is started. Only returns on failure.
+ * @param cfg Settings of the searches
+ * @param nworkers Number of worker processes
+ * @param worker Search run by each worker process
+ * @return Program exit code
+ */
+int runFarm(const SearchConfig_t &cfg, u32 nworkers, FarmWorker_t worker);
+
+#endif // _FARM_H_
@@ -34,6 +34,7 @@
 
 #define NMAX (64)
 #define PARWORDSIZE (64)
+#define MAXLANES (8)        ///< Maximum number of BPWord_t per line in a group of test vectors (8*64 = 512 bit SIMD)
 
 using std::size_t;
 
@@ -53,8 +54,23 @@ struct Pair_t{
 
 typedef std::vector<Pair_t> Network_t;
 
+/**
+ * Layer of a network: CEs acting on disjoint lines, that can be applied in parallel
+ */
+struct Layer_t{
+	SortWord_t lines; ///< Mask of the lines used by the CEs of the layer, including their mirror images for symmetric networks
+	Network_t ces;    ///< CEs of the layer
+};
+
+typedef std::vector<Layer_t> LayeredNetwork_t;
+
 typedef std::vector<SortWord_t> SinglePatternList_t;
 
+/**
+ * Bit-parallel test vectors. Vectors are organised in groups of lanes*PARWORDSIZE vectors, "lanes" being
+ * the number of BPWord_t that are processed together by the test kernel.
+ * Word for line k, lane w of group g is found at index (g*ninputs+k)*lanes+w.
+ */
 typedef std::vector<BPWord_t> BitParallelList_t;
 
 
@@ -43,6 +43,22 @@ void OCH_t::clear()
 	och.clear();
 }
 
+/**
+ * Check whether a (size, depth) pair would be an improvement, without adding it
+ * @param l length of network
+ * @param d depth of network
+ * @return true if no pair of the OCH is at least as good in both criteria
+ */
+bool OCH_t::wouldImprove(u32 l, u32 d) const
+{
+	for(size_t k=0;k<och.size();k++)
+	{
+		if((l>=och[k].size)&&(d>=och[k].depth))
+			return false;
+	}
+	return true;
+}
+
 /**
  * Add a (size, depth) pair to the OCH computation
  * @param l length of network found
@@ -51,15 +67,7 @@ void OCH_t::clear()
  */
 bool OCH_t::improved(u32 l, u32 d)
 {
-	bool matched=false;
-	
-	for(size_t k=0;k<och.size();k++)
-	{
-		if((l>=och[k].size)&&(d>=och[k].depth))
-			matched=true;
-	}
-	
-	if(matched)
+	if(!wouldImprove(l,d))
 		return false;
 	
 	std::vector<OCH_Entry> newch;
@@ -98,6 +106,68 @@ void OCH_t::print() const
 
 
 
+/**
+ * Best performing (length, depth) pairs found so far, as text
+ * @return List of pairs, like "[(19,9),(20,8)]"
+ */
+std::string OCH_t::toString() const
+{
+	std::string s="[";
+	for(size_t k=0;k<och.size();k++)
+	{
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%s(%u,%u)", (k>0) ? "," : "", och[k].size, och[k].depth);
+		s+=buf;
+	}
+	return s+"]";
+}
+
+void RandGen_t::seed(uint64_t seedval)
+{
+	for(u32 k=0;k<4;k++)
+	{
+		uint64_t z=(seedval+=0x9e3779b97f4a7c15ULL);
+		z=(z^(z>>30))*0xbf58476d1ce4e5b9ULL;
+		z=(z^(z>>27))*0x94d049bb133111ebULL;
+		s[k]=z^(z>>31);
+	}
+}
+
+/**
+ * Advance the state by the jump polynomial of xoshiro256
+ * @param poly Jump polynomial
+ */
+void RandGen_t::jump(const uint64_t poly[4])
+{
+	uint64_t t[4]={0,0,0,0};
+	for(u32 k=0;k<4;k++)
+	{
+		for(u32 b=0;b<64;b++)
+		{
+			if(poly[k] & (1ULL<<b))
+			{
+				for(u32 j=0;j<4;j++)
+					t[j]^=s[j];
+			}
+			(*this)();
+		}
+	}
+	for(u32 j=0;j<4;j++)
+		s[j]=t[j];
+}
+
+void RandGen_t::jump()
+{
+	static const uint64_t poly[4]={0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+	jump(poly);
+}
+
+void RandGen_t::longJump()
+{
+	static const uint64_t poly[4]={0x76e15d3efefdcbbfULL, 0xc5004e441c522fb3ULL, 0x77710069854ee241ULL, 0x39109bb02acbe635ULL};
+	jump(poly);
+}
+
 u32 computeDepth(const Network_t &nw)
 {
 	std::vector<SortWord_t> layers;
@@ -134,6 +204,82 @@ u32 computeDepth(const Network_t &nw)
 }
 
 
+SortWord_t ceLines(u8 ninputs, bool symmetric, const Pair_t &p)
+{
+	SortWord_t m=(1ULL<<p.lo)|(1ULL<<p.hi);
+	if(symmetric)
+	{
+		m|=(1ULL<<(ninputs-1-p.lo))|(1ULL<<(ninputs-1-p.hi));
+	}
+	return m;
+}
+
+
+bool computeLayerLines(u8 ninputs, bool symmetric, Layer_t &layer)
+{
+	layer.lines=0;
+	for(size_t k=0;k<layer.ces.size();k++)
+	{
+		SortWord_t m=ceLines(ninputs, symmetric, layer.ces[k]);
+		if(layer.lines & m)
+		{
+			return false;
+		}
+		layer.lines|=m;
+	}
+	return true;
+}
+
+
+void layerNetwork(u8 ninputs, bool symmetric, const Network_t &nw, LayeredNetwork_t &layers)
+{
+	int lastlayer[NMAX];
+	for(u32 k=0;k<ninputs;k++)
+	{
+		lastlayer[k]=-1;
+	}
+	
+	layers.clear();
+	for(size_t k=0;k<nw.size();k++)
+	{
+		SortWord_t m=ceLines(ninputs, symmetric, nw[k]);
+		int idx=-1;
+		for(u32 i=0;i<ninputs;i++)
+		{
+			if(((m>>i)&1) && (lastlayer[i]>idx))
+			{
+				idx=lastlayer[i];
+			}
+		}
+		idx++;
+		if(idx>=(int)layers.size())
+		{
+			layers.push_back(Layer_t());
+			layers.back().lines=0;
+		}
+		layers[idx].ces.push_back(nw[k]);
+		layers[idx].lines|=m;
+		for(u32 i=0;i<ninputs;i++)
+		{
+			if((m>>i)&1)
+			{
+				lastlayer[i]=idx;
+			}
+		}
+	}
+}
+
+
+void flattenLayers(const LayeredNetwork_t &layers, Network_t &nw)
+{
+	nw.clear();
+	for(size_t k=0;k<layers.size();k++)
+	{
+		nw.insert(nw.end(), layers[k].ces.begin(), layers[k].ces.end());
+	}
+}
+
+
 void printnw(const Network_t &nw)
 {
 	printf("[");
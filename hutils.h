@@ -31,6 +31,7 @@
 
 #include "htypes.h"
 #include <random>
+#include <string>
 
 inline u32 min(u32 x,u32 y) { return (x<y)?x:y;} ///< Classic minimum
 inline u32 max(u32 x,u32 y) { return (x>y)?x:y;} ///< Classic maximum
@@ -42,6 +43,40 @@ inline u32 max(u32 x,u32 y) { return (x>y)?x:y;} ///< Classic maximum
  */
 u32 computeDepth(const Network_t &nw);
 
+/**
+ * Lines used by a CE, and by its mirror image for symmetric networks
+ * @param ninputs Number of inputs
+ * @param symmetric Include the mirror image of the CE
+ * @param p CE
+ * @return Line mask
+ */
+SortWord_t ceLines(u8 ninputs, bool symmetric, const Pair_t &p);
+
+/**
+ * Recompute the line mask of a layer
+ * @param ninputs Number of inputs
+ * @param symmetric Include the mirror images of the CEs
+ * @param layer [IN/OUT] Layer to update
+ * @return false if the CEs of the layer do not act on disjoint lines
+ */
+bool computeLayerLines(u8 ninputs, bool symmetric, Layer_t &layer);
+
+/**
+ * Split a network in layers. Each CE is put in the first layer after the last layer that uses one of its lines.
+ * @param ninputs Number of inputs
+ * @param symmetric Network is the core of a symmetric network: each CE is accompanied by its mirror image
+ * @param nw Input network
+ * @param layers [OUT] Layered network
+ */
+void layerNetwork(u8 ninputs, bool symmetric, const Network_t &nw, LayeredNetwork_t &layers);
+
+/**
+ * Concatenate the layers of a layered network
+ * @param layers Layered network
+ * @param nw [OUT] Flat network
+ */
+void flattenLayers(const LayeredNetwork_t &layers, Network_t &nw);
+
 /**
  * Create "symmetric" sorting network by creating a mirror image of each pair if it doesn't coincide with the original.
  * Note: for networks with odd input sizes, the mirror image of a pair connected to the middle line will necessarilly belong
@@ -84,7 +119,9 @@ public:
 	OCH_t();
 	void clear();
 	bool improved(u32 size, u32 depth);
+	bool wouldImprove(u32 size, u32 depth) const;
 	void print() const;
+	std::string toString() const;
 private: 
 	struct OCH_Entry{
 		u32 size;
@@ -96,9 +133,79 @@ private:
 
 // Random generation defs
 
-typedef std::mt19937_64 RandGen_t;
+/**
+ * xoshiro256** generator (D. Blackman, S. Vigna): 32 bytes of state, a few instructions per draw, and jump functions that split
+ * its period in non-overlapping streams for threads. Meets the requirements of a uniform random bit generator (std::shuffle etc.).
+ */
+class RandGen_t {
+public:
+	typedef uint64_t result_type;
+	
+	RandGen_t(uint64_t seedval=5489u) { seed(seedval); }
+	
+	/**
+	 * Reset the state, expanding the seed with splitmix64
+	 * @param seedval Seed
+	 */
+	void seed(uint64_t seedval);
+	
+	static constexpr result_type min() { return 0; }          ///< Smallest value drawn
+	static constexpr result_type max() { return UINT64_MAX; } ///< Largest value drawn
+	
+	/**
+	 * Draw a 64 bit value
+	 * @return Random value
+	 */
+	result_type operator()()
+	{
+		uint64_t result=rotl(s[1]*5, 7)*9;
+		uint64_t t=s[1]<<17;
+		s[2]^=s[0];
+		s[3]^=s[1];
+		s[1]^=s[2];
+		s[0]^=s[3];
+		s[2]^=t;
+		s[3]=rotl(s[3], 45);
+		return result;
+	}
+	
+	/**
+	 * Draw an unbiased value in 0..n-1 by multiply-shift (D. Lemire), without a division in the common case
+	 * @param n Number of possible values, >0
+	 * @return Random value
+	 */
+	uint64_t below(uint64_t n)
+	{
+		unsigned __int128 m=(unsigned __int128)(*this)()*n;
+		uint64_t low=(uint64_t)m;
+		if(low<n)
+		{
+			uint64_t threshold=(0-n)%n; // 2^64 mod n
+			while(low<threshold)
+			{
+				m=(unsigned __int128)(*this)()*n;
+				low=(uint64_t)m;
+			}
+		}
+		return (uint64_t)(m>>64);
+	}
+	
+	/**
+	 * Advance by 2^128 draws: start of the next stream of a speculation worker
+	 */
+	void jump();
+	
+	/**
+	 * Advance by 2^192 draws: start of the next stream of an island, each one has room for 2^64 worker streams
+	 */
+	void longJump();
+private:
+	static uint64_t rotl(uint64_t x, int k) { return (x<<k) | (x>>(64-k)); }
+	void jump(const uint64_t poly[4]);
+	uint64_t s[4]; ///< Generator state
+};
 
-#define RANDIDX(v) (mtRand()%v.size())      ///< Random index from vector
+#define RANDIDX(v) (mtRand.below(v.size()))  ///< Random index from vector
 #define RANDELEM(v) (v[RANDIDX(v)])         ///< Random element from vector
 
 #endif
@@ -31,23 +31,84 @@
 #include <algorithm>
 #include <cstdio>
 #include <cassert>
+#include <thread>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <immintrin.h>
 
-extern u32 Verbosity;
+#define BITMAPMAXLINES 16 ///< Clusters of up to this many lines store their output patterns as a bitmap
+
+#define PARALLEL_MIN_PATTERNS (1u<<16) ///< Minimum number of patterns handled by each thread when pattern lists are built in parallel
+
+static thread_local bool inParallelJob=false; ///< The thread runs a part of a runParallel job, nested jobs are not split
+
+/**
+ * Number of threads to use for a job on a pattern list
+ * @param n Number of independent items the job can be split in
+ * @param work Number of patterns the job produces
+ * @return Number of threads, 1 if the job is too small to be worth splitting or runs inside a part of another job
+ */
+static u32 workerCount(size_t n, uint64_t work)
+{
+	if(inParallelJob || (work<2*(uint64_t)PARALLEL_MIN_PATTERNS))
+		return 1;
+	uint64_t nthreads=std::max(1u, std::thread::hardware_concurrency());
+	nthreads=std::min(nthreads, work/PARALLEL_MIN_PATTERNS);
+	nthreads=std::min(nthreads, (uint64_t)n);
+	return std::max((u32)nthreads, 1u);
+}
+
+/**
+ * Splits items 0..n-1 in nparts consecutive ranges and processes each range in a thread of its own.
+ * Part t covers items n*t/nparts up to n*(t+1)/nparts. The calling thread handles the first part.
+ * Jobs started from within a part (e.g. pattern list merges while scoring prefix candidates) run on the thread of that part.
+ * @param nparts Number of parts, see workerCount
+ * @param n Number of items
+ * @param job Function called with the first and the end index of each part
+ */
+static void runParallel(u32 nparts, size_t n, const std::function<void(size_t, size_t)> &job)
+{
+	if(nparts<=1)
+	{
+		job(0, n);
+		return;
+	}
+	
+	std::vector<std::thread> threads;
+	for(u32 t=1;t<nparts;t++)
+	{
+		threads.push_back(std::thread([&job](size_t first, size_t last) {
+			inParallelJob=true;
+			job(first, last);
+		}, n*t/nparts, n*(t+1)/nparts));
+	}
+	bool nested=inParallelJob;
+	inParallelJob=true;
+	job(0, n/nparts);
+	inParallelJob=nested;
+	for(size_t t=0;t<threads.size();t++)
+	{
+		threads[t].join();
+	}
+}
 
 /**
  * Replaces a *sorted* list of patterns applied to a network containing a single CE by the sorted list of output patterns of that network.
  * The sort order is low to high, a pattern represents the binary representation of an input/output state
  * Restriction to sorted pattern lists allows to compute the output list in linear time.
- * @param patterns [IN/OUT] Input and output list of patterns, sorted.
+ * @param patterns Input list of patterns, sorted.
  * @param pair Representation of CE to apply
+ * @param res [OUT] Output list of patterns, sorted. Must not be the input list.
  */
-static void swap_sortedpatterns( SinglePatternList_t &patterns, const Pair_t &pair)
+static void swap_sortedpatterns( const SinglePatternList_t &patterns, const Pair_t &pair, SinglePatternList_t &res)
 {
 	SortWord_t p=1ULL << pair.lo;
 	SortWord_t q=1ULL << pair.hi;
 	SortWord_t mask=p|q;
 	
-	SinglePatternList_t res;
+	res.clear();
+	res.reserve(patterns.size());
 	
 	size_t idxp=0;
 	size_t idxnp=0;
@@ -90,8 +151,343 @@ static void swap_sortedpatterns( SinglePatternList_t &patterns, const Pair_t &pa
 	{
 		res.push_back(patterns[idxp++]^mask);
 	}
+}
+
+/**
+ * Merges the bitwise "ored" combinations of two sorted pattern lists acting on disjoint lines. For a fixed pattern of the first list,
+ * the combinations with the patterns of the second list are already sorted, so the rows are merged with a heap.
+ * @param rows First list, sorted, preferably the shorter one
+ * @param cols Second list, sorted
+ * @param first First index in cols
+ * @param last End index in cols
+ * @param out [OUT] Receives the rows.size()*(last-first) combinations with cols[first..last-1], sorted
+ */
+static void merge_combinations(const SinglePatternList_t &rows, const SinglePatternList_t &cols, size_t first, size_t last, SortWord_t *out)
+{
+	struct Cursor_t {
+		SortWord_t w; ///< Current combination of the row
+		size_t row;   ///< Index in rows
+		size_t col;   ///< Index in cols
+	};
+	auto later=[](const Cursor_t &a, const Cursor_t &b) { return a.w>b.w; };
+	
+	if(first>=last)
+		return;
+	std::vector<Cursor_t> heap;
+	heap.reserve(rows.size());
+	for(size_t r=0;r<rows.size();r++)
+	{
+		heap.push_back({rows[r]|cols[first], r, first});
+	}
+	std::make_heap(heap.begin(), heap.end(), later);
 	
-	patterns=res;
+	while(!heap.empty())
+	{
+		std::pop_heap(heap.begin(), heap.end(), later);
+		Cursor_t &c=heap.back();
+		*out++ = c.w;
+		if(++c.col<last)
+		{
+			c.w=rows[c.row]|cols[c.col];
+			std::push_heap(heap.begin(), heap.end(), later);
+		}
+		else
+		{
+			heap.pop_back();
+		}
+	}
+}
+
+/**
+ * Recycles the pattern lists of a cluster group and its copies, so that the many copies and updates made by the greedy prefix
+ * search reuse the same few allocations. Thread safe, as the greedy prefix search scores candidates on several threads.
+ */
+class PatternPool : public std::enable_shared_from_this<PatternPool> {
+	public:
+		/**
+		 * Take a list from the pool. It is handed back when the last reference to it is dropped.
+		 * @return Empty list, possibly with capacity left from an earlier use
+		 */
+		std::shared_ptr<SinglePatternList_t> acquire()
+		{
+			SinglePatternList_t *list=NULL;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if(!freelists.empty())
+				{
+					list=freelists.back();
+					freelists.pop_back();
+				}
+			}
+			if(list==NULL)
+			{
+				list=new SinglePatternList_t;
+			}
+			list->clear();
+			std::shared_ptr<PatternPool> self=shared_from_this();
+			return std::shared_ptr<SinglePatternList_t>(list, [self](SinglePatternList_t *l) { self->release(l); });
+		}
+		
+		~PatternPool()
+		{
+			for(size_t k=0;k<freelists.size();k++)
+				delete freelists[k];
+		}
+	private:
+		void release(SinglePatternList_t *list)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			freelists.push_back(list);
+		}
+		
+		std::mutex lock;                              ///< Protects freelists
+		std::vector<SinglePatternList_t *> freelists; ///< Unused lists
+};
+
+/**
+ * Scatters the low bits of x to the positions of the bits set in mask (as the BMI2 pdep instruction)
+ */
+static SortWord_t depositBits(SortWord_t x, SortWord_t mask)
+{
+	SortWord_t res=0;
+	while(mask!=0)
+	{
+		SortWord_t bit=mask&(~mask+1);
+		if(x&1)
+			res|=bit;
+		x>>=1;
+		mask^=bit;
+	}
+	return res;
+}
+
+/**
+ * Gathers the bits of x at the positions of the bits set in mask into the low bits (as the BMI2 pext instruction)
+ */
+static SortWord_t extractBits(SortWord_t x, SortWord_t mask)
+{
+	SortWord_t res=0;
+	u32 pos=0;
+	while(mask!=0)
+	{
+		SortWord_t bit=mask&(~mask+1);
+		if(x&bit)
+			res|=1ULL<<pos;
+		pos++;
+		mask^=bit;
+	}
+	return res;
+}
+
+__attribute__((target("bmi2")))
+static void depositAllBMI2(const SortWord_t *in, size_t n, SortWord_t mask, SortWord_t *out)
+{
+	for(size_t k=0;k<n;k++)
+		out[k]=_pdep_u64(in[k], mask);
+}
+
+/**
+ * Scatters the low bits of a list of values to the positions of the bits set in mask, with pdep if the CPU supports it
+ * @param in Values
+ * @param n Number of values
+ * @param mask Target bit positions
+ * @param out [OUT] Scattered values, may be the same as in
+ */
+static void depositAll(const SortWord_t *in, size_t n, SortWord_t mask, SortWord_t *out)
+{
+	static const bool hasBMI2=(__builtin_cpu_init(), __builtin_cpu_supports("bmi2"));
+	if(hasBMI2)
+	{
+		depositAllBMI2(in, n, mask, out);
+		return;
+	}
+	for(size_t k=0;k<n;k++)
+		out[k]=depositBits(in[k], mask);
+}
+
+/*
+ * Bitmap representation of the output set of a small cluster: bit x of the bitmap is set if the cluster can output the pattern
+ * that has the bits of x at the positions of its lines (x is the pext of the pattern with the mask of the cluster). This holds
+ * max(1,2^(nlines-6)) words.
+ */
+
+/**
+ * Word of which bit i is set if bit t of i is set
+ * @param t Bit index, 0..5
+ */
+static BPWord_t bitmapIndexMask(u32 t)
+{
+	static const BPWord_t masks[6]={0xaaaaaaaaaaaaaaaaULL, 0xccccccccccccccccULL, 0xf0f0f0f0f0f0f0f0ULL, 0xff00ff00ff00ff00ULL, 0xffff0000ffff0000ULL, 0xffffffff00000000ULL};
+	return masks[t];
+}
+
+/**
+ * Applies a CE to a bitmap pattern set: patterns with a 1 at line a and a 0 at line b move to index x-2^a+2^b.
+ * @param bitmap [IN/OUT] Bitmap, see above
+ * @param nlines Number of lines of the cluster
+ * @param a Index of the low line of the CE among the lines of the cluster
+ * @param b Index of the high line of the CE among the lines of the cluster, b>a
+ * @return Number of patterns removed because their image was already in the set
+ */
+static SortWord_t swap_bitmap(SortWord_t *bitmap, u32 nlines, u32 a, u32 b)
+{
+	SortWord_t removed=0;
+	const size_t nwords=(nlines>6) ? (1ULL<<(nlines-6)) : 1;
+	if(b<6)
+	{
+		// Within each word: masked shift-and-or
+		BPWord_t m=bitmapIndexMask(a)&~bitmapIndexMask(b);
+		u32 d=(1u<<b)-(1u<<a);
+		for(size_t w=0;w<nwords;w++)
+		{
+			BPWord_t moved=(bitmap[w]&m)<<d;
+			BPWord_t kept=bitmap[w]&~m;
+			removed+=__builtin_popcountll(moved&kept);
+			bitmap[w]=kept|moved;
+		}
+	}
+	else if(a<6)
+	{
+		// Bits move to a word of higher index, towards lower bit positions
+		BPWord_t m=bitmapIndexMask(a);
+		size_t wb=1ULL<<(b-6);
+		u32 d=1u<<a;
+		for(size_t w=0;w<nwords;w++)
+		{
+			if(w&wb)
+				continue;
+			BPWord_t moved=(bitmap[w]&m)>>d;
+			bitmap[w]&=~m;
+			removed+=__builtin_popcountll(moved&bitmap[w+wb]);
+			bitmap[w+wb]|=moved;
+		}
+	}
+	else
+	{
+		// Whole words move
+		size_t wa=1ULL<<(a-6);
+		size_t wb=1ULL<<(b-6);
+		for(size_t w=0;w<nwords;w++)
+		{
+			if(((w&wa)==0) || (w&wb))
+				continue;
+			removed+=__builtin_popcountll(bitmap[w]&bitmap[w-wa+wb]);
+			bitmap[w-wa+wb]|=bitmap[w];
+			bitmap[w]=0;
+		}
+	}
+	return removed;
+}
+
+/**
+ * Counts the patterns that swap_bitmap would remove, without modifying the bitmap
+ * @param bitmap Bitmap, see above
+ * @param nlines Number of lines of the cluster
+ * @param a Index of the low line of the CE among the lines of the cluster
+ * @param b Index of the high line of the CE among the lines of the cluster, b>a
+ * @return Number of patterns of which the image is already in the set
+ */
+static SortWord_t count_bitmap_duplicates(const SortWord_t *bitmap, u32 nlines, u32 a, u32 b)
+{
+	SortWord_t removed=0;
+	const size_t nwords=(nlines>6) ? (1ULL<<(nlines-6)) : 1;
+	if(b<6)
+	{
+		BPWord_t m=bitmapIndexMask(a)&~bitmapIndexMask(b);
+		u32 d=(1u<<b)-(1u<<a);
+		for(size_t w=0;w<nwords;w++)
+			removed+=__builtin_popcountll(((bitmap[w]&m)<<d)&bitmap[w]);
+	}
+	else if(a<6)
+	{
+		BPWord_t m=bitmapIndexMask(a);
+		size_t wb=1ULL<<(b-6);
+		u32 d=1u<<a;
+		for(size_t w=0;w<nwords;w++)
+			if((w&wb)==0)
+				removed+=__builtin_popcountll(((bitmap[w]&m)>>d)&bitmap[w+wb]);
+	}
+	else
+	{
+		size_t wa=1ULL<<(a-6);
+		size_t wb=1ULL<<(b-6);
+		for(size_t w=0;w<nwords;w++)
+			if((w&wa) && ((w&wb)==0))
+				removed+=__builtin_popcountll(bitmap[w]&bitmap[w-wa+wb]);
+	}
+	return removed;
+}
+
+/**
+ * Counts the pairs of patterns of a bitmap pattern set that differ only in one line
+ * @param bitmap Bitmap, see above
+ * @param nlines Number of lines of the cluster
+ * @param t Index of the line among the lines of the cluster
+ * @return Number of patterns with a 0 at line t that are still in the set with a 1 at line t
+ */
+static SortWord_t count_bitmap_pairs(const SortWord_t *bitmap, u32 nlines, u32 t)
+{
+	SortWord_t count=0;
+	const size_t nwords=(nlines>6) ? (1ULL<<(nlines-6)) : 1;
+	if(t<6)
+	{
+		BPWord_t m=~bitmapIndexMask(t);
+		u32 d=1u<<t;
+		for(size_t w=0;w<nwords;w++)
+			count+=__builtin_popcountll(bitmap[w]&m&(bitmap[w]>>d));
+	}
+	else
+	{
+		size_t wt=1ULL<<(t-6);
+		for(size_t w=0;w<nwords;w++)
+			if((w&wt)==0)
+				count+=__builtin_popcountll(bitmap[w]&bitmap[w+wt]);
+	}
+	return count;
+}
+
+/**
+ * Counts the patterns of a sorted list of which a fixed transformation, increasing over the patterns it applies to, is also in the list
+ * @param patterns Sorted pattern list
+ * @param select Mask of the bits that select the patterns to transform
+ * @param selected Value of the selected bits of the patterns to transform
+ * @param flip Bits flipped by the transformation
+ * @return Number of patterns w with (w&select)==selected such that w^flip is in the list
+ */
+static SortWord_t count_sorted_images(const SinglePatternList_t &patterns, SortWord_t select, SortWord_t selected, SortWord_t flip)
+{
+	SortWord_t count=0;
+	size_t j=0;
+	const size_t l=patterns.size();
+	for(size_t i=0;i<l;i++)
+	{
+		if((patterns[i]&select)!=selected)
+			continue;
+		SortWord_t image=patterns[i]^flip;
+		while((j<l) && (patterns[j]<image)) { j++; }
+		if((j<l) && (patterns[j]==image))
+			count++;
+	}
+	return count;
+}
+
+/**
+ * Lists the patterns of a bitmap pattern set
+ * @param bitmap Bitmap, see above
+ * @param mask Lines of the cluster
+ * @param patterns [OUT] Patterns of the set, sorted
+ */
+static void bitmapToPatterns(const SinglePatternList_t &bitmap, SortWord_t mask, SinglePatternList_t &patterns)
+{
+	patterns.clear();
+	for(size_t w=0;w<bitmap.size();w++)
+	{
+		for(BPWord_t bits=bitmap[w];bits!=0;bits&=bits-1)
+		{
+			patterns.push_back(w*PARWORDSIZE+__builtin_ctzll(bits));
+		}
+	}
+	depositAll(patterns.data(), patterns.size(), mask, patterns.data()); // pdep keeps the order
 }
 
 /**
@@ -112,13 +508,21 @@ class ClusterGroup{
 		void clear();
 		void preSort(Pair_t p);
 		void computeOutputs(SinglePatternList_t &patterns) const;
+		void getClusters(std::vector<SinglePatternList_t> &clusters) const;
 		SortWord_t outputSize() const;
 		bool isSameCluster(Pair_t p) const;
+		SortWord_t sizeAfter(Pair_t p, const Pair_t *q) const;
+		SortWord_t largestCluster() const;
 		~ClusterGroup();
 	private:
+		SortWord_t clusterSizeAfter(Pair_t p) const;
 		void combine(u8 i, u8 j);
+		void combineBitmaps(u8 i, u8 j);
+		const SinglePatternList_t &sortedPatterns(u32 k, SinglePatternList_t &buffer) const;
 		
-		SinglePatternList_t *patternlists; ///< Sorted list of output patterns from each cluster of lines
+		std::shared_ptr<PatternPool> pool; ///< Storage of the pattern lists, shared with copies of the group
+		std::shared_ptr<const SinglePatternList_t> *patternlists; ///< Output patterns of each cluster of lines: a bitmap (see swap_bitmap) for clusters of up to BITMAPMAXLINES lines, a sorted list for larger ones. Shared with copies of the group until modified
+		SortWord_t *sizes; ///< Number of output patterns of each cluster
 		SortWord_t *masks; ///< Masks for each cluster marking the applicable lines for each cluster
 		u8 *clusterAlloc; ///< Allocations of lines to clusters
 		u8 ninputs; ///< Total number of inputs (and outputs) of the network
@@ -131,24 +535,29 @@ class ClusterGroup{
 ClusterGroup::ClusterGroup(u8 n)
 {
 	ninputs=n;
-	patternlists = new SinglePatternList_t[ninputs];
+	pool = std::make_shared<PatternPool>();
+	patternlists = new std::shared_ptr<const SinglePatternList_t>[ninputs];
+	sizes = new SortWord_t[ninputs];
 	masks = new SortWord_t[ninputs];
 	clusterAlloc = new u8[ninputs];
 	clear();
 }
 
 /**
- * Copy constructor
+ * Copy constructor. The pattern lists are shared until one of both groups modifies them.
  */
 ClusterGroup::ClusterGroup(const ClusterGroup &cg)
 {
 	ninputs = cg.ninputs;
-	patternlists = new SinglePatternList_t[ninputs];
+	pool = cg.pool;
+	patternlists = new std::shared_ptr<const SinglePatternList_t>[ninputs];
+	sizes = new SortWord_t[ninputs];
 	masks = new SortWord_t[ninputs];
 	clusterAlloc = new u8[ninputs];
 	for(u32 k=0;k<ninputs;k++)
 	{
 		patternlists[k] = cg.patternlists[k];
+		sizes[k]=cg.sizes[k];
 		masks[k]=cg.masks[k];
 		clusterAlloc[k]=cg.clusterAlloc[k];
 	}
@@ -160,9 +569,11 @@ ClusterGroup::ClusterGroup(const ClusterGroup &cg)
 const ClusterGroup& ClusterGroup::operator=(const ClusterGroup &cg)
 {
 	ninputs = cg.ninputs;
+	pool = cg.pool;
 	for(u32 k=0;k<ninputs;k++)
 	{
 		patternlists[k] = cg.patternlists[k];
+		sizes[k]=cg.sizes[k];
 		masks[k]=cg.masks[k];
 		clusterAlloc[k]=cg.clusterAlloc[k];
 	}	
@@ -175,6 +586,7 @@ const ClusterGroup& ClusterGroup::operator=(const ClusterGroup &cg)
 ClusterGroup::~ClusterGroup()
 {
 	delete[] patternlists;
+	delete[] sizes;
 	delete[] masks;
 	delete[] clusterAlloc;
 }
@@ -190,9 +602,10 @@ void ClusterGroup::clear()
 	{
 		clusterAlloc[k]=k;
 		masks[k]=1ULL<<k;
-		patternlists[k].clear();
-		patternlists[k].push_back(0);
-		patternlists[k].push_back(1ULL<<k);
+		std::shared_ptr<SinglePatternList_t> bitmap=pool->acquire();
+		bitmap->push_back(3); // Patterns 0 and 1<<k
+		patternlists[k]=bitmap;
+		sizes[k]=2;
 	}	
 }
 
@@ -204,29 +617,105 @@ void ClusterGroup::clear()
  */
 void ClusterGroup::combine(u8 ci_idx, u8 cj_idx)
 {
-	SinglePatternList_t &p1=patternlists[ci_idx];
-	SinglePatternList_t &p2=patternlists[cj_idx];
-	
 	for(u32 k=0;k<ninputs;k++)
 		if(clusterAlloc[k]==cj_idx)
 			clusterAlloc[k]=ci_idx; // ci will take over
 	
-	masks[ci_idx]|=masks[cj_idx];
-	SinglePatternList_t cp;
+	if(__builtin_popcountll(masks[ci_idx]|masks[cj_idx])<=BITMAPMAXLINES)
+	{
+		masks[ci_idx]|=masks[cj_idx];
+		combineBitmaps(ci_idx, cj_idx);
+		return;
+	}
+	
 	/*
-	 * Combined cluster's output patterns are here simply generated by producing all
-	 * patterns, first disregarding their final order and sorting them afterwards.
-	 * At first, I had an algorithm in place that broke the masks into chunks allowing
-	 * in order generation that had lower theoretical complexity. For practical sizes however
-	 * a quicksort proved a faster and simpler alternative. (and probably has less bugs :-) )
+	 * The rows of combinations with each pattern of the shorter list are sorted, and merged into the new output set.
+	 * Large sets are merged on several threads, each one taking a range of the longer list, after which the sorted
+	 * ranges are merged pairwise.
 	 */
-	for(size_t i=0;i<p1.size();i++)
-		for(size_t j=0;j<p2.size();j++)
-			cp.push_back( p1[i] | p2[j]);
-	std::sort(cp.begin(),cp.end()); // Keep the new output set sorted
-	p1=cp;
+	SinglePatternList_t buffer_i, buffer_j;
+	const SinglePatternList_t &list_i=sortedPatterns(ci_idx, buffer_i);
+	const SinglePatternList_t &list_j=sortedPatterns(cj_idx, buffer_j);
+	const SinglePatternList_t &rows=(list_i.size()<=list_j.size()) ? list_i : list_j;
+	const SinglePatternList_t &cols=(&rows==&list_i) ? list_j : list_i;
+	const size_t nrows=rows.size();
+	const size_t ncols=cols.size();
+	std::shared_ptr<SinglePatternList_t> cp=pool->acquire();
+	cp->resize(nrows*ncols);
+	
+	u32 nparts=workerCount(ncols, (uint64_t)nrows*ncols);
+	runParallel(nparts, ncols, [&](size_t first, size_t last) {
+		merge_combinations(rows, cols, first, last, cp->data()+nrows*first);
+	});
+	if(nparts>1)
+	{
+		std::shared_ptr<SinglePatternList_t> merged=pool->acquire();
+		merged->resize(nrows*ncols);
+		for(u32 width=1;width<nparts;width*=2)
+		{
+			u32 nmerges=(nparts+2*width-1)/(2*width);
+			runParallel(nmerges, nmerges, [&](size_t first, size_t last) {
+				for(size_t m=first;m<last;m++)
+				{
+					size_t lo=nrows*(ncols*std::min(2*m*width, (size_t)nparts)/nparts);
+					size_t mid=nrows*(ncols*std::min((2*m+1)*width, (size_t)nparts)/nparts);
+					size_t hi=nrows*(ncols*std::min((2*m+2)*width, (size_t)nparts)/nparts);
+					std::merge(cp->begin()+lo, cp->begin()+mid, cp->begin()+mid, cp->begin()+hi, merged->begin()+lo);
+				}
+			});
+			cp.swap(merged);
+		}
+	}
+	patternlists[ci_idx]=cp;
+	sizes[ci_idx]=cp->size();
+	masks[ci_idx]|=masks[cj_idx];
 	masks[cj_idx]=0;
-	p2.clear();
+	patternlists[cj_idx].reset();
+}
+
+/**
+ * Combines two bitmap clusters into a bitmap cluster, as combine
+ * @param ci_idx First cluster index (new result cluster), its mask already covers both clusters
+ * @param cj_idx Second cluster index (will no longer be used)
+ */
+void ClusterGroup::combineBitmaps(u8 ci_idx, u8 cj_idx)
+{
+	const SortWord_t mask=masks[ci_idx];
+	const SortWord_t mask_j=masks[cj_idx];
+	const SortWord_t mask_i=mask&~mask_j;
+	
+	// Bitmap indices of both clusters, scattered to the positions of their lines among the lines of the combined cluster
+	SinglePatternList_t indices_i, indices_j;
+	bitmapToPatterns(*patternlists[ci_idx], extractBits(mask_i, mask), indices_i);
+	bitmapToPatterns(*patternlists[cj_idx], extractBits(mask_j, mask), indices_j);
+	
+	const u32 nlines=__builtin_popcountll(mask);
+	std::shared_ptr<SinglePatternList_t> bitmap=pool->acquire();
+	bitmap->assign((nlines>6) ? (1ULL<<(nlines-6)) : 1, 0);
+	for(size_t i=0;i<indices_i.size();i++)
+		for(size_t j=0;j<indices_j.size();j++)
+		{
+			SortWord_t x=indices_i[i]|indices_j[j];
+			(*bitmap)[x/PARWORDSIZE]|=1ULL<<(x%PARWORDSIZE);
+		}
+	patternlists[ci_idx]=bitmap;
+	sizes[ci_idx]=indices_i.size()*indices_j.size();
+	masks[cj_idx]=0;
+	patternlists[cj_idx].reset();
+}
+
+/**
+ * Sorted output patterns of a cluster
+ * @param k Cluster index
+ * @param buffer Storage for the list, if the cluster is a bitmap
+ * @return List of patterns
+ */
+const SinglePatternList_t &ClusterGroup::sortedPatterns(u32 k, SinglePatternList_t &buffer) const
+{
+	if(__builtin_popcountll(masks[k])>BITMAPMAXLINES)
+		return *patternlists[k];
+	bitmapToPatterns(*patternlists[k], masks[k], buffer);
+	return buffer;
 }
 
 
@@ -238,48 +727,147 @@ bool ClusterGroup::isSameCluster(Pair_t p) const
 }
 
 /**
- * Reduces the number of patterns represented by appending a single CE to the network.
- * If the CE's lines belong to different clusters, the clusters are merged first.
+ * Number of output patterns of the cluster(s) of the lines of a CE, after appending the CE to the network
  * @param p CE represented by its input/output lines
  */
-void ClusterGroup::preSort(Pair_t p)
+SortWord_t ClusterGroup::clusterSizeAfter(Pair_t p) const
 {
 	u32	ci_idx=clusterAlloc[p.lo];
 	u32 cj_idx=clusterAlloc[p.hi];
+	const SortWord_t p_lo=1ULL<<p.lo;
+	const SortWord_t p_hi=1ULL<<p.hi;
 	
-	if(ci_idx!=cj_idx)
+	if(ci_idx==cj_idx)
 	{
-		combine(ci_idx,cj_idx);
+		// Patterns with a 1 at p.lo and a 0 at p.hi move, and disappear if their image is already present
+		if(__builtin_popcountll(masks[ci_idx])<=BITMAPMAXLINES)
+		{
+			u32 a=__builtin_popcountll(masks[ci_idx]&(p_lo-1));
+			u32 b=__builtin_popcountll(masks[ci_idx]&(p_hi-1));
+			return sizes[ci_idx]-count_bitmap_duplicates(patternlists[ci_idx]->data(), __builtin_popcountll(masks[ci_idx]), a, b);
+		}
+		return sizes[ci_idx]-count_sorted_images(*patternlists[ci_idx], p_lo|p_hi, p_lo, p_lo|p_hi);
+	}
+	
+	/*
+	 * Combined cluster: pattern (x,y) with a 1 at p.lo in x and a 0 at p.hi in y moves to (x^p_lo,y^p_hi). Its image is
+	 * already present if both x^p_lo and y^p_hi are output patterns of their cluster, which is counted per cluster.
+	 */
+	SortWord_t pairs[2];
+	const u32 idx[2]={ci_idx, cj_idx};
+	const SortWord_t bits[2]={p_lo, p_hi};
+	for(u32 k=0;k<2;k++)
+	{
+		SortWord_t mask=masks[idx[k]];
+		if(__builtin_popcountll(mask)<=BITMAPMAXLINES)
+			pairs[k]=count_bitmap_pairs(patternlists[idx[k]]->data(), __builtin_popcountll(mask), __builtin_popcountll(mask&(bits[k]-1)));
+		else
+			pairs[k]=count_sorted_images(*patternlists[idx[k]], bits[k], 0, bits[k]);
 	}
-	swap_sortedpatterns( patternlists[ci_idx], p);
+	return sizes[ci_idx]*sizes[cj_idx]-pairs[0]*pairs[1];
 }
 
 /**
- * Compute the list of output patterns that can leave the network composed of all
- * clusters remaining. This is done by "oring" together output combinations of all remaining clusters.
- * @param patterns [OUT] pattern list created (not lexographically sorted)
+ * Compute the number of output patterns that computeOutputs would produce after appending one or two CEs, without
+ * modifying the group. Only the clusters of the lines of the CEs are examined.
+ * @param p First CE
+ * @param q Second CE, applied after p, or NULL if none
  */
-void ClusterGroup::computeOutputs(SinglePatternList_t &patterns) const
+SortWord_t ClusterGroup::sizeAfter(Pair_t p, const Pair_t *q) const
 {
-	const static SinglePatternList_t *pLists[NMAX];
-	int n_to_combine=0;
+	u32 touched[4]={clusterAlloc[p.lo], clusterAlloc[p.hi], clusterAlloc[p.lo], clusterAlloc[p.hi]};
+	if(q!=NULL)
+	{
+		touched[2]=clusterAlloc[q->lo];
+		touched[3]=clusterAlloc[q->hi];
+		if((touched[2]==touched[0]) || (touched[2]==touched[1]) || (touched[3]==touched[0]) || (touched[3]==touched[1]))
+		{
+			// The CEs interact: apply them to a copy, which only shares the pattern lists
+			ClusterGroup cg(*this);
+			cg.preSort(p);
+			cg.preSort(*q);
+			return cg.outputSize();
+		}
+	}
 	
+	SortWord_t prod=clusterSizeAfter(p);
+	if(q!=NULL)
+		prod*=clusterSizeAfter(*q);
 	for(u32 k=0;k<ninputs;k++)
 	{
-		if(masks[k]!=0)
-			pLists[n_to_combine++] = &patternlists[k];
+		if((masks[k]!=0) && (k!=touched[0]) && (k!=touched[1]) && (k!=touched[2]) && (k!=touched[3]))
+			prod *= sizes[k];
 	}
 	
-	assert(n_to_combine>0);
+	if(prod==0) // Same wrap-around as in outputSize
+		prod-=1;
+	return prod;
+}
+
+/**
+ * Number of output patterns of the largest cluster, a measure of the work of sizeAfter
+ */
+SortWord_t ClusterGroup::largestCluster() const
+{
+	SortWord_t largest=0;
+	for(u32 k=0;k<ninputs;k++)
+	{
+		if(masks[k]!=0)
+			largest=std::max(largest, sizes[k]);
+	}
+	return largest;
+}
+
+/**
+ * Reduces the number of patterns represented by appending a single CE to the network.
+ * If the CE's lines belong to different clusters, the clusters are merged first.
+ * @param p CE represented by its input/output lines
+ */
+void ClusterGroup::preSort(Pair_t p)
+{
+	u32	ci_idx=clusterAlloc[p.lo];
+	u32 cj_idx=clusterAlloc[p.hi];
 	
+	if(ci_idx!=cj_idx)
+	{
+		combine(ci_idx,cj_idx);
+	}
+	std::shared_ptr<SinglePatternList_t> res=pool->acquire();
+	u32 nlines=__builtin_popcountll(masks[ci_idx]);
+	if(nlines<=BITMAPMAXLINES)
+	{
+		*res=*patternlists[ci_idx];
+		u32 a=__builtin_popcountll(masks[ci_idx]&((1ULL<<p.lo)-1));
+		u32 b=__builtin_popcountll(masks[ci_idx]&((1ULL<<p.hi)-1));
+		sizes[ci_idx]-=swap_bitmap(res->data(), nlines, a, b);
+	}
+	else
+	{
+		swap_sortedpatterns( *patternlists[ci_idx], p, *res);
+		sizes[ci_idx]=res->size();
+	}
+	patternlists[ci_idx]=res;
+}
+
+/**
+ * Produce the bitwise "ored" combinations of one pattern from each list, the first list varying slowest
+ * @param pLists Pattern lists to combine
+ * @param n_to_combine Number of lists
+ * @param first First index in the first list
+ * @param last End index in the first list
+ * @param out [OUT] Output buffer, receives (last-first) times the product of the sizes of the other lists
+ */
+static void expandOutputs(const SinglePatternList_t *const *pLists, int n_to_combine, size_t first, size_t last, SortWord_t *out)
+{
 	int level=0;
 	size_t indices[NMAX]={0};
 	SortWord_t outmasks[NMAX]={0};
-	patterns.clear();
+	indices[0]=first;
 	
 	while(level>=0)
 	{	
-		if(indices[level]< pLists[level]->size())
+		size_t end=(level==0) ? last : pLists[level]->size();
+		if(indices[level]<end)
 		{
 			if(level==0)
 				outmasks[level] = (*pLists[level])[indices[level]];
@@ -293,7 +881,7 @@ void ClusterGroup::computeOutputs(SinglePatternList_t &patterns) const
 			}
 			else
 			{
-				patterns.push_back( outmasks[level]);
+				*out++ = outmasks[level];
 				indices[level]++;
 			}		
 		}
@@ -304,6 +892,58 @@ void ClusterGroup::computeOutputs(SinglePatternList_t &patterns) const
 	}
 }
 
+/**
+ * Compute the list of output patterns that can leave the network composed of all
+ * clusters remaining. This is done by "oring" together output combinations of all remaining clusters.
+ * @param patterns [OUT] pattern list created (not lexographically sorted)
+ */
+void ClusterGroup::computeOutputs(SinglePatternList_t &patterns) const
+{
+	const SinglePatternList_t *pLists[NMAX];
+	SinglePatternList_t buffers[NMAX];
+	int n_to_combine=0;
+	
+	for(u32 k=0;k<ninputs;k++)
+	{
+		if(masks[k]!=0)
+		{
+			pLists[n_to_combine] = &sortedPatterns(k, buffers[n_to_combine]);
+			n_to_combine++;
+		}
+	}
+	
+	assert(n_to_combine>0);
+	
+	// Split the first list over the threads: the patterns of each thread form a consecutive range of the output
+	uint64_t total=1;
+	for(int c=0;c<n_to_combine;c++)
+		total*=pLists[c]->size();
+	const size_t nfirst=pLists[0]->size();
+	const uint64_t rest=total/nfirst;
+	patterns.resize(total);
+	runParallel(workerCount(nfirst, total), nfirst, [&](size_t first, size_t last) {
+		expandOutputs(pLists, n_to_combine, first, last, patterns.data()+first*rest);
+	});
+}
+
+/**
+ * Get the output pattern lists of all remaining clusters. The output set of the network is
+ * formed by all bitwise "ored" combinations of one pattern from each list.
+ * @param clusters [OUT] Sorted output pattern list of each cluster
+ */
+void ClusterGroup::getClusters(std::vector<SinglePatternList_t> &clusters) const
+{
+	clusters.clear();
+	for(u32 k=0;k<ninputs;k++)
+	{
+		if(masks[k]!=0)
+		{
+			SinglePatternList_t buffer;
+			clusters.push_back(sortedPatterns(k, buffer));
+		}
+	}
+}
+
 /**
  * Compute number of output patterns that would be produced by call to computeOutputs
  */
@@ -314,7 +954,7 @@ SortWord_t ClusterGroup::outputSize() const
 	for(u32 k=0;k<ninputs;k++)
 	{
 		if(masks[k]!=0)
-			prod *= patternlists[k].size();
+			prod *= sizes[k];
 	}
 	
 #if 1
@@ -326,9 +966,13 @@ SortWord_t ClusterGroup::outputSize() const
 }
 
 
-void computePrefixOutputs(u8 ninputs, const Network_t &prefix, SinglePatternList_t &patterns)
+/**
+ * Apply all pairs of a prefix to a cluster group
+ * @param prefix Prefix to process
+ * @param cg [IN/OUT] Cluster group, initially cleared
+ */
+static void applyPrefix(const Network_t &prefix, ClusterGroup &cg)
 {
-	ClusterGroup cg(ninputs);
 	Network_t todo = prefix;
 	
 	while(todo.size() > 0)
@@ -357,10 +1001,90 @@ void computePrefixOutputs(u8 ninputs, const Network_t &prefix, SinglePatternList
 		}
 		todo = postponed;
 	}
-	
+}
+
+
+void computePrefixOutputs(u8 ninputs, const Network_t &prefix, SinglePatternList_t &patterns)
+{
+	ClusterGroup cg(ninputs);
+	applyPrefix(prefix, cg);
 	cg.computeOutputs(patterns);
 }
 
+
+void computePrefixClusters(u8 ninputs, const Network_t &prefix, std::vector<SinglePatternList_t> &clusters)
+{
+	ClusterGroup cg(ninputs);
+	applyPrefix(prefix, cg);
+	cg.getClusters(clusters);
+}
+
+uint64_t countPrefixOutputs(const std::vector<SinglePatternList_t> &clusters)
+{
+	uint64_t count=1;
+	for(size_t c=0;c<clusters.size();c++)
+	{
+		uint64_t size=clusters[c].size();
+		if((size>0) && (count>UINT64_MAX/size))
+			return UINT64_MAX;
+		count*=size;
+	}
+	return count;
+}
+
+void enumeratePrefixOutputs(const std::vector<SinglePatternList_t> &clusters, uint64_t first, size_t count, SinglePatternList_t &patterns)
+{
+	const size_t nclusters=clusters.size();
+	std::vector<size_t> digits(nclusters);
+	SortWord_t w=0;
+	
+	patterns.clear();
+	for(size_t c=0;c<nclusters;c++)
+	{
+		digits[c]=first%clusters[c].size();
+		first/=clusters[c].size();
+		w|=clusters[c][digits[c]];
+	}
+	if(first>0)
+		return; // Beyond the end of the set
+	
+	while(patterns.size()<count)
+	{
+		patterns.push_back(w);
+		
+		// Increment the mixed radix number, updating only the clusters whose digit changes
+		size_t c=0;
+		while(c<nclusters)
+		{
+			w&=~clusters[c][digits[c]];
+			if(++digits[c]<clusters[c].size())
+			{
+				w|=clusters[c][digits[c]];
+				break;
+			}
+			digits[c]=0;
+			w|=clusters[c][0];
+			c++;
+		}
+		if(c==nclusters)
+			break; // Wrapped around: all patterns produced
+	}
+}
+
+void samplePrefixOutputs(const std::vector<SinglePatternList_t> &clusters, size_t count, RandGen_t &rndgen, SinglePatternList_t &patterns)
+{
+	patterns.resize(count);
+	for(size_t n=0;n<count;n++)
+	{
+		SortWord_t w=0;
+		for(size_t c=0;c<clusters.size();c++)
+		{
+			w|=clusters[c][rndgen.below(clusters[c].size())];
+		}
+		patterns[n]=w;
+	}
+}
+
 /**
  * For symmetric networks, any network that sorts a pattern successfully will also sort the reverse of the inverse,
  * i.e. if a symmetric network sorts '00101111', if will also sort '00001011'
@@ -380,80 +1104,230 @@ static bool hasSmallerMirror(u8 ninputs, SortWord_t w)
 }
 
 
-static SortWord_t all_n_inputs_mask; ///< ninputs lowest bit to be set
-
 static bool isSorted(u8 ninputs, SortWord_t w)
 {
+	const SortWord_t all_n_inputs_mask = ~0ULL >> (64-ninputs); // ninputs lowest bit to be set
 	w = ~w & all_n_inputs_mask;
 	return (w&(w+1)) == 0;
 }
 
 
-void convertToBitParallel(u8 ninputs, const SinglePatternList_t &singles, bool use_symmetry, BitParallelList_t &parallels)
+/**
+ * Packs single patterns in groups of bit parallel test vectors, skipping the patterns that are useless as test vectors
+ */
+class BitParallelWriter{
+	public:
+		/**
+		 * Start packing
+		 * @param ninputs Number of inputs
+		 * @param use_symmetry Skip patterns of which the mirror image is smaller
+		 * @param lanes Number of BPWord_t per line in a group
+		 * @param parallels [OUT] List the groups are appended to
+		 */
+		BitParallelWriter(u8 ninputs, bool use_symmetry, u32 lanes, BitParallelList_t &parallels) :
+			ninputs(ninputs), use_symmetry(use_symmetry), lanes(lanes), parallels(parallels)
+		{
+			for(u32 k=0;k<ninputs*lanes;k++)
+			{
+				buffer[k]=0;
+			}
+		}
+		
+		/**
+		 * Add a pattern
+		 * @param w Pattern
+		 */
+		void add(SortWord_t w)
+		{
+			if(use_symmetry && hasSmallerMirror(ninputs, w))
+			{
+				return; // Complement of reverse word is smaller, skip this vector if the network is symmetric
+			}
+			
+			if(isSorted(ninputs, w))
+			{
+				return; // Already sorted pattern will not be affected by sorting operation - useless as test vector
+			}
+			
+			u32 lane=level/PARWORDSIZE;
+			u32 bit=level%PARWORDSIZE;
+			for(u32 b=0;b<ninputs;b++)
+			{
+				buffer[b*lanes+lane]|=(w&1)<<bit;
+				w>>=1;
+			}
+			level++;
+			
+			if(level>=lanes*PARWORDSIZE)
+			{
+				for(u32 k=0;k<ninputs*lanes;k++)
+				{
+					parallels.push_back(buffer[k]);
+					buffer[k]=0;
+				}
+				level=0;			
+			}	
+		}
+		
+		/**
+		 * Append the last, partially filled group
+		 */
+		void flush()
+		{
+			if(level>0)
+			{
+				for(u32 k=0;k<ninputs*lanes;k++)
+				{
+					parallels.push_back(buffer[k]);
+					buffer[k]=0;
+				}
+				level=0;
+			}
+		}
+	private:
+		u8 ninputs;                  ///< Number of inputs
+		bool use_symmetry;           ///< Skip patterns of which the mirror image is smaller
+		u32 lanes;                   ///< Number of BPWord_t per line in a group
+		BitParallelList_t &parallels; ///< Output list
+		u32 level=0;                 ///< Number of patterns in the current group
+		BPWord_t buffer[NMAX*MAXLANES]; ///< Current group
+};
+
+void convertToBitParallel(u8 ninputs, const SinglePatternList_t &singles, bool use_symmetry, u32 lanes, BitParallelList_t &parallels, u32 verbosity)
 {
-	u32 level=0;
-	static BPWord_t buffer[NMAX];
 	parallels.clear();
-	
-	all_n_inputs_mask = 0ULL;
-	for(u32 k=0;k<ninputs;k++)
+	BitParallelWriter writer(ninputs, use_symmetry, lanes, parallels);
+	for(size_t idx=0;idx<singles.size();idx++)
 	{
-		all_n_inputs_mask |= 1ULL << k;
+		writer.add(singles[idx]);
 	}
-	
-	for(size_t idx=0;idx<singles.size();idx++)
+	writer.flush();
+
+	if(verbosity > 2)
 	{
-		SortWord_t w=singles[idx];
-		if(use_symmetry && hasSmallerMirror(ninputs, w))
+		printf("Debug: Pattern conversion: %lu single inputs -> %lu parallel words (%u * %u * %lu) (symmetry:%d)\n", singles.size(), parallels.size(), ninputs, lanes, parallels.size()/(ninputs*lanes), use_symmetry);
+	}
+}
+
+/**
+ * Pseudorandom bijection of 0..n-1: a balanced Feistel network on the smallest even number of bits covering n, with cycle walking
+ * to map values beyond n back into range
+ */
+class IndexPermutation{
+	public:
+		/**
+		 * Draw a permutation
+		 * @param n Number of indices
+		 * @param rndgen Random generator for the round keys
+		 */
+		IndexPermutation(uint64_t n, RandGen_t &rndgen) : n(n)
 		{
-			continue; // Complement of reverse word is smaller, skip this vector if the network is symmetric
+			u32 bits=2;
+			while((bits<64) && ((n-1)>>bits))
+				bits+=2;
+			halfbits=bits/2;
+			halfmask=(1ULL<<halfbits)-1;
+			for(u32 r=0;r<ROUNDS;r++)
+			{
+				keys[r]=rndgen();
+			}
 		}
 		
-		if(isSorted(ninputs, w))
+		/**
+		 * Permuted index
+		 * @param i Index, 0..n-1
+		 * @return Image of i, 0..n-1
+		 */
+		uint64_t operator()(uint64_t i) const
 		{
-			continue; // Already sorted pattern will not be affected by sorting operation - useless as test vector
+			do {
+				i=encrypt(i);
+			} while(i>=n);
+			return i;
 		}
+	private:
+		static const u32 ROUNDS=4; ///< Number of Feistel rounds
 		
-		for(u32 b=0;b<ninputs;b++)
+		uint64_t encrypt(uint64_t x) const
 		{
-			buffer[b]<<=1;
-			buffer[b]|=(w&1);
-			w>>=1;
+			uint64_t left=x>>halfbits;
+			uint64_t right=x&halfmask;
+			for(u32 r=0;r<ROUNDS;r++)
+			{
+				uint64_t f=(right^keys[r])*0x9e3779b97f4a7c15ULL; // Round function: multiplicative hash of the right half
+				f^=f>>29;
+				uint64_t t=right;
+				right=(left^f)&halfmask;
+				left=t;
+			}
+			return (left<<halfbits)|right;
 		}
-		level++;
 		
-		if(level>=PARWORDSIZE)
+		uint64_t n;            ///< Number of indices
+		u32 halfbits;          ///< Number of bits of each half
+		uint64_t halfmask;     ///< Mask of a half
+		uint64_t keys[ROUNDS]; ///< Round keys
+};
+
+void streamPrefixOutputs(u8 ninputs, const std::vector<SinglePatternList_t> &clusters, bool use_symmetry, u32 lanes, RandGen_t &rndgen, BitParallelList_t &parallels, u32 verbosity)
+{
+	const uint64_t total=countPrefixOutputs(clusters);
+	const uint64_t nblocks=(total+STREAMBLOCKSIZE-1)/STREAMBLOCKSIZE;
+	const u32 groupwords=ninputs*lanes;
+	
+	/* Symmetry discards about half of the patterns */
+	uint64_t estimate=use_symmetry ? (total/2+1) : total;
+	parallels.clear();
+	parallels.reserve(((estimate+lanes*PARWORDSIZE-1)/(lanes*PARWORDSIZE))*groupwords);
+	
+	/* Blocks are taken in a pseudorandom order, and each window of blocks is shuffled before conversion */
+	BitParallelWriter writer(ninputs, use_symmetry, lanes, parallels);
+	IndexPermutation blockorder(nblocks, rndgen);
+	SinglePatternList_t window;
+	std::vector<uint64_t> blocks;
+	std::vector<size_t> offsets;
+	for(uint64_t b=0;b<nblocks;b+=STREAMWINDOWBLOCKS)
+	{
+		blocks.clear();
+		offsets.clear();
+		size_t size=0;
+		for(uint64_t k=b;(k<nblocks) && (k<b+STREAMWINDOWBLOCKS);k++)
 		{
-			for(u32 b=0;b<ninputs;b++)
+			uint64_t first=blockorder(k)*STREAMBLOCKSIZE;
+			blocks.push_back(first);
+			offsets.push_back(size);
+			size+=std::min((uint64_t)STREAMBLOCKSIZE, total-first);
+		}
+		window.resize(size);
+		runParallel(workerCount(blocks.size(), size), blocks.size(), [&](size_t first, size_t last) {
+			SinglePatternList_t block;
+			for(size_t k=first;k<last;k++)
 			{
-				parallels.push_back(buffer[b]);
-				buffer[b]=0; // Needed ? Probably not, but cleaner.
+				enumeratePrefixOutputs(clusters, blocks[k], STREAMBLOCKSIZE, block);
+				std::copy(block.begin(), block.end(), window.begin()+offsets[k]);
 			}
-			level=0;			
-		}	
-	}
-	if(level>0)
-	{
-		for(u32 b=0;b<ninputs;b++)
+		});
+		std::shuffle(window.begin(), window.end(), rndgen);
+		for(size_t k=0;k<window.size();k++)
 		{
-			parallels.push_back(buffer[b]);
+			writer.add(window[k]);
 		}
 	}
-
-	if(Verbosity > 2)
+	writer.flush();
+	
+	if(verbosity > 2)
 	{
-		printf("Debug: Pattern conversion: %lu single inputs -> %lu parallel words (%u * %lu) (symmetry:%d)\n", singles.size(), parallels.size(), ninputs, parallels.size()/ninputs, use_symmetry);
+		printf("Debug: Pattern streaming: %lu prefix outputs -> %lu parallel words (%u * %u * %lu) (symmetry:%d)\n", total, parallels.size(), ninputs, lanes, parallels.size()/groupwords, use_symmetry);
 	}
 }
 
-static Network_t alphabet; ///< "Alphabet" of possible CEs defined by their vertical positions.
-
 /**
  * Initialize alphabet of CEs. 
  * @param ninputs Number of network inputs
  * @param use_symmetry If set to true duplicates due to mirroring will be omitted
+ * @param alphabet [OUT] "Alphabet" of possible CEs defined by their vertical positions.
  */
-static void initAlphabet(u8 ninputs, bool use_symmetry)
+static void initAlphabet(u8 ninputs, bool use_symmetry, Network_t &alphabet)
 {
 	alphabet.clear();
 	for(u32 i=0;i<(ninputs-1u);i++)
@@ -470,14 +1344,15 @@ static void initAlphabet(u8 ninputs, bool use_symmetry)
 		}
 }		
 
-SortWord_t createGreedyPrefix(u8 ninputs, u32 maxpairs, bool use_symmetry, Network_t &prefix, RandGen_t &rndgen)
+SortWord_t createGreedyPrefix(u8 ninputs, u32 maxpairs, bool use_symmetry, Network_t &prefix, RandGen_t &rndgen, u32 verbosity)
 {
-	if(Verbosity>2)
+	Network_t alphabet;
+	if(verbosity>2)
 	{
 		printf("Creating greedy prefix. Initial prefix size = %lu, max prefix size %u.\n",prefix.size(),maxpairs);
 	}
 	ClusterGroup cg(ninputs);
-	initAlphabet(ninputs, use_symmetry);
+	initAlphabet(ninputs, use_symmetry, alphabet);
 
 	for(size_t k=0;k<prefix.size();k++)
 		cg.preSort(prefix[k]);
@@ -490,47 +1365,46 @@ SortWord_t createGreedyPrefix(u8 ninputs, u32 maxpairs, bool use_symmetry, Netwo
 		std::shuffle(ashuf.begin(),ashuf.end(), rndgen);
 		SortWord_t minsize = currentsize;
 
-		ClusterGroup cgbest=cg;
-		SortWord_t minfuturesize = currentsize;
-		for(size_t k=0;k<alphabet.size();k++)
-		{
-			ClusterGroup cgnew = cg;
-			cgnew.preSort(ashuf[k]);
-			if(use_symmetry && ((ashuf[k].lo+ashuf[k].hi) != (ninputs-1)))
+		// Score all candidates without modifying the group, on several threads if the clusters are large
+		std::vector<SortWord_t> newsizes(ashuf.size());
+		runParallel(workerCount(ashuf.size(), ashuf.size()*cg.largestCluster()), ashuf.size(), [&](size_t first, size_t last) {
+			for(size_t k=first;k<last;k++)
 			{
 				Pair_t p = { (u8)(ninputs-1-ashuf[k].hi), (u8)(ninputs-1-ashuf[k].lo) };
-				cgnew.preSort(p);
+				bool mirrored=use_symmetry && ((ashuf[k].lo+ashuf[k].hi) != (ninputs-1));
+				newsizes[k]=cg.sizeAfter(ashuf[k], mirrored ? &p : NULL);
 			}
-			SortWord_t newsize = cgnew.outputSize();
-			SortWord_t futuresize = newsize;
-			if(futuresize<minfuturesize)
+		});
+		
+		for(size_t k=0;k<ashuf.size();k++)
+		{
+			if(newsizes[k]<minsize)
 			{
-				minsize=newsize;
-				minfuturesize=futuresize;
+				minsize=newsizes[k];
 				best=ashuf[k];
-				cgbest=cgnew;
 			}
 		}
 		
 		if(minsize>=currentsize)
 		{
 			// Found no improvement
-			if(Verbosity>2)
+			if(verbosity>2)
 			{
 				printf("Greedy algorithm: no further improvement.\n");
 			}
 			break;
 		}
-		cg=cgbest;
-		if(Verbosity>2)
+		if(verbosity>2)
 		{
 			printf("Greedy: adding pair (%u,%u)\n",best.lo,best.hi);
 		}
 		prefix.push_back(best);
+		cg.preSort(best);
 		if(use_symmetry && ((best.lo+best.hi) != (ninputs-1)))
 		{
 			Pair_t p = { (u8)(ninputs-1-best.hi), (u8)(ninputs-1-best.lo) };
-			if(Verbosity>2)
+			cg.preSort(p);
+			if(verbosity>2)
 			{
 				printf("Greedy: adding symmetric pair (%u,%u)\n",p.lo,p.hi);
 			}
@@ -541,3 +1415,228 @@ SortWord_t createGreedyPrefix(u8 ninputs, u32 maxpairs, bool use_symmetry, Netwo
 	return currentsize;
 }
 
+/**
+ * Canonical order of a network under exchanges of adjacent CEs that share no line, which leave the outputs unchanged.
+ * Each CE gets the level of the last earlier CE on one of its lines plus one, CEs are then ordered by level and by lines.
+ * Two networks have the same canonical order if and only if one is obtained from the other by such exchanges.
+ * @param nw Network
+ * @param key [OUT] Canonical order of nw
+ */
+static void canonicalOrder(const Network_t &nw, Network_t &key)
+{
+	u32 linelevel[NMAX]={0};
+	std::vector<std::pair<u32,Pair_t> > levels;
+	for(size_t k=0;k<nw.size();k++)
+	{
+		u32 level=std::max(linelevel[nw[k].lo], linelevel[nw[k].hi])+1;
+		linelevel[nw[k].lo]=level;
+		linelevel[nw[k].hi]=level;
+		levels.push_back(std::make_pair(level, nw[k]));
+	}
+	std::sort(levels.begin(), levels.end(), [](const std::pair<u32,Pair_t> &a, const std::pair<u32,Pair_t> &b) {
+		return (a.first<b.first) || ((a.first==b.first) && (a.second.lo<b.second.lo));
+	});
+	key.clear();
+	for(size_t k=0;k<levels.size();k++)
+		key.push_back(levels[k].second);
+}
+
+/**
+ * Partial prefix in the beam of createBeamPrefix
+ */
+struct BeamState_t {
+	ClusterGroup cg;     ///< Clusters after the prefix
+	Network_t prefix;    ///< Prefix pairs
+	SortWord_t size;     ///< Number of outputs of the prefix
+};
+
+/**
+ * Extension of a beam state by one pair (and its mirror image)
+ */
+struct BeamCandidate_t {
+	SortWord_t size;     ///< Number of outputs after the extension
+	size_t state;        ///< Index of the extended state in the beam
+	Pair_t pair;         ///< Added pair
+	size_t order;        ///< Position in the scoring order, breaks ties as the greedy search does
+};
+
+/**
+ * Beam search from a start state, see createBeamPrefix
+ * @param ninputs Number of inputs
+ * @param alphabet Pairs that can be added
+ * @param maxpairs Maximum number of pairs in the prefix
+ * @param use_symmetry Pairs are added together with their mirror image
+ * @param beamwidth Number of partial prefixes kept in each step
+ * @param depth Maximum number of steps, 0 for no limit
+ * @param start Start state
+ * @param rndgen Random number generator for shuffling
+ * @param verbosity Verbosity level, debug output is printed above 2
+ * @return State with the fewest outputs found, start if no extension reduces the number of outputs
+ */
+static BeamState_t beamSearch(u8 ninputs, const Network_t &alphabet, u32 maxpairs, bool use_symmetry, u32 beamwidth, u32 depth, const BeamState_t &start, RandGen_t &rndgen, u32 verbosity)
+{
+	std::vector<BeamState_t> beam(1, start);
+	BeamState_t best=start;
+	size_t lineage=0; // State that follows the greedy choices, always kept in the beam, SIZE_MAX once it stopped
+	
+	for(u32 step=0;(depth==0) || (step<depth);step++)
+	{
+		// States that may still grow, each with its own random order of the alphabet
+		std::vector<size_t> growing;
+		std::vector<Network_t> orders;
+		for(size_t s=0;s<beam.size();s++)
+		{
+			u32 size=beam[s].prefix.size();
+			if((size < maxpairs) || (use_symmetry && (size<(maxpairs-1))))
+			{
+				growing.push_back(s);
+				orders.push_back(alphabet);
+				std::shuffle(orders.back().begin(), orders.back().end(), rndgen);
+			}
+		}
+		if(growing.empty())
+			break;
+		
+		// Score all extensions of all states without modifying them, on several threads if the clusters are large
+		const size_t nalpha=alphabet.size();
+		std::vector<SortWord_t> newsizes(growing.size()*nalpha);
+		SortWord_t largest=0;
+		for(size_t g=0;g<growing.size();g++)
+			largest=std::max(largest, beam[growing[g]].cg.largestCluster());
+		runParallel(workerCount(newsizes.size(), newsizes.size()*largest), newsizes.size(), [&](size_t first, size_t last) {
+			for(size_t n=first;n<last;n++)
+			{
+				const Pair_t &e=orders[n/nalpha][n%nalpha];
+				Pair_t p = { (u8)(ninputs-1-e.hi), (u8)(ninputs-1-e.lo) };
+				bool mirrored=use_symmetry && ((e.lo+e.hi) != (ninputs-1));
+				newsizes[n]=beam[growing[n/nalpha]].cg.sizeAfter(e, mirrored ? &p : NULL);
+			}
+		});
+		
+		// Keep the smallest improving extensions. Extensions that only differ in the order of pairs without common lines are kept once.
+		std::vector<BeamCandidate_t> candidates;
+		for(size_t n=0;n<newsizes.size();n++)
+		{
+			if(newsizes[n]<beam[growing[n/nalpha]].size)
+			{
+				candidates.push_back(BeamCandidate_t{newsizes[n], growing[n/nalpha], orders[n/nalpha][n%nalpha], n});
+			}
+		}
+		if(candidates.empty())
+			break;
+		std::sort(candidates.begin(), candidates.end(), [](const BeamCandidate_t &a, const BeamCandidate_t &b) {
+			return (a.size<b.size) || ((a.size==b.size) && (a.order<b.order));
+		});
+		
+		// The best extension of the greedy lineage goes first, so that the beam always holds a greedy prefix
+		std::vector<size_t> picks;
+		for(size_t c=0;c<candidates.size();c++)
+		{
+			if(candidates[c].state==lineage)
+			{
+				picks.push_back(c);
+				break;
+			}
+		}
+		lineage=picks.empty() ? SIZE_MAX : 0;
+		for(size_t c=0;c<candidates.size();c++)
+		{
+			if(picks.empty() || (c!=picks[0]))
+				picks.push_back(c);
+		}
+		
+		std::vector<BeamState_t> next;
+		std::vector<Network_t> keys;
+		for(size_t i=0;(i<picks.size()) && (next.size()<beamwidth);i++)
+		{
+			size_t c=picks[i];
+			BeamState_t state=beam[candidates[c].state];
+			Pair_t e=candidates[c].pair;
+			state.prefix.push_back(e);
+			state.cg.preSort(e);
+			if(use_symmetry && ((e.lo+e.hi) != (ninputs-1)))
+			{
+				Pair_t p = { (u8)(ninputs-1-e.hi), (u8)(ninputs-1-e.lo) };
+				state.prefix.push_back(p);
+				state.cg.preSort(p);
+			}
+			state.size=candidates[c].size;
+			
+			Network_t key;
+			canonicalOrder(state.prefix, key);
+			bool seen=false;
+			for(size_t k=0;(k<keys.size()) && !seen;k++)
+			{
+				seen=(keys[k].size()==key.size()) && std::equal(key.begin(), key.end(), keys[k].begin(), [](const Pair_t &a, const Pair_t &b) { return (a.lo==b.lo) && (a.hi==b.hi); });
+			}
+			if(seen)
+				continue;
+			keys.push_back(key);
+			next.push_back(state);
+		}
+		beam.swap(next);
+		size_t smallest=0;
+		for(size_t s=0;s<beam.size();s++)
+		{
+			if(beam[s].size<beam[smallest].size)
+				smallest=s;
+		}
+		if(beam[smallest].size<best.size)
+		{
+			best=beam[smallest];
+		}
+		if(verbosity>2)
+		{
+			printf("Beam search: %lu states, best prefix size %lu with %lu outputs.\n",beam.size(),beam[smallest].prefix.size(),(size_t)beam[smallest].size);
+		}
+	}
+	
+	return best;
+}
+
+SortWord_t createBeamPrefix(u8 ninputs, u32 maxpairs, bool use_symmetry, u32 beamwidth, u32 beamdepth, Network_t &prefix, RandGen_t &rndgen, u32 verbosity)
+{
+	Network_t alphabet;
+	if(verbosity>2)
+	{
+		printf("Creating beam search prefix. Initial prefix size = %lu, max prefix size %u, beam width %u, depth %u.\n",prefix.size(),maxpairs,beamwidth,beamdepth);
+	}
+	initAlphabet(ninputs, use_symmetry, alphabet);
+	
+	BeamState_t current{ClusterGroup(ninputs), prefix, 0};
+	for(size_t k=0;k<prefix.size();k++)
+		current.cg.preSort(prefix[k]);
+	current.size=current.cg.outputSize();
+	
+	if(beamdepth==0)
+	{
+		current=beamSearch(ninputs, alphabet, maxpairs, use_symmetry, beamwidth, 0, current, rndgen, verbosity);
+	}
+	else
+	{
+		// Look beamdepth steps ahead, then only commit to the first step towards the best state found
+		for(;;)
+		{
+			BeamState_t best=beamSearch(ninputs, alphabet, maxpairs, use_symmetry, beamwidth, beamdepth, current, rndgen, verbosity);
+			if(best.prefix.size()==current.prefix.size())
+				break;
+			Pair_t e=best.prefix[current.prefix.size()];
+			current.prefix.push_back(e);
+			current.cg.preSort(e);
+			if(use_symmetry && ((e.lo+e.hi) != (ninputs-1)))
+			{
+				Pair_t p = { (u8)(ninputs-1-e.hi), (u8)(ninputs-1-e.lo) };
+				current.prefix.push_back(p);
+				current.cg.preSort(p);
+			}
+			current.size=current.cg.outputSize();
+			if(verbosity>2)
+			{
+				printf("Beam search: committed to prefix size %lu with %lu outputs.\n",current.prefix.size(),(size_t)current.size);
+			}
+		}
+	}
+	
+	prefix=current.prefix;
+	return current.size;
+}
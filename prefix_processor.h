@@ -41,15 +41,71 @@
  */
 void computePrefixOutputs(u8 ninputs, const Network_t &prefix, SinglePatternList_t &patterns);
 
+/**
+ * Given a prefix, computes the output pattern lists of the independent line clusters it leaves behind, without enumerating the full output set.
+ * The output set of the prefix consists of all bitwise "ored" combinations of one pattern from each cluster.
+ * @param ninputs Number of inputs to the partially ordered network
+ * @param prefix Prefix to process
+ * @param clusters [OUT] Sorted output pattern list of each cluster
+ */
+void computePrefixClusters(u8 ninputs, const Network_t &prefix, std::vector<SinglePatternList_t> &clusters);
+
+/**
+ * Number of output patterns of a prefix, i.e. the product of the sizes of its cluster pattern lists
+ * @param clusters Output pattern lists of the clusters, see computePrefixClusters
+ * @return Number of output patterns, saturated at UINT64_MAX
+ */
+uint64_t countPrefixOutputs(const std::vector<SinglePatternList_t> &clusters);
+
+/**
+ * Enumerates a range of the output set of a prefix without building the complete set. Patterns are numbered in mixed radix,
+ * the first cluster being the least significant digit.
+ * @param clusters Output pattern lists of the clusters, see computePrefixClusters
+ * @param first Number of the first pattern to produce
+ * @param count Maximum number of patterns to produce, fewer are produced at the end of the set
+ * @param patterns [OUT] Output patterns
+ */
+void enumeratePrefixOutputs(const std::vector<SinglePatternList_t> &clusters, uint64_t first, size_t count, SinglePatternList_t &patterns);
+
+/**
+ * Draws random output patterns of a prefix, by picking a random pattern of each cluster. Each pattern of the output set is
+ * equally likely, duplicates are possible.
+ * @param clusters Output pattern lists of the clusters, see computePrefixClusters
+ * @param count Number of patterns to draw
+ * @param rndgen Random number generator
+ * @param patterns [OUT] Output patterns
+ */
+void samplePrefixOutputs(const std::vector<SinglePatternList_t> &clusters, size_t count, RandGen_t &rndgen, SinglePatternList_t &patterns);
+
 /**
  * Converts a set of prefix output patterns to a bit parallel data structure to speed up testing of the "postfix" network.
- * The word size for packing is given by PARWORDSIZE
+ * Patterns are packed in groups of lanes*PARWORDSIZE, see BitParallelList_t for the layout.
  * @param ninputs Number of inputs to the partially ordered network
  * @param singles Prefix output patterns to convert
  * @param use_symmetry Optimize using symmetry
+ * @param lanes Number of BPWord_t per line in a group (1..MAXLANES)
  * @param parallels [OUT] Bit parallel representations of the patterns
+ * @param verbosity Verbosity level, debug output is printed above 2
  */
-void convertToBitParallel(u8 ninputs, const SinglePatternList_t &singles, bool use_symmetry, BitParallelList_t &parallels);
+void convertToBitParallel(u8 ninputs, const SinglePatternList_t &singles, bool use_symmetry, u32 lanes, BitParallelList_t &parallels, u32 verbosity);
+
+#define STREAMBLOCKSIZE 4096     ///< Number of consecutive prefix outputs enumerated together by streamPrefixOutputs
+#define STREAMWINDOWBLOCKS 256   ///< Number of blocks shuffled together by streamPrefixOutputs
+
+/**
+ * Enumerates the output set of a prefix in a pseudorandom order, and packs it directly in bit parallel groups as convertToBitParallel
+ * does, without building the list of single patterns. Blocks of STREAMBLOCKSIZE consecutive outputs are taken in the order of a
+ * random bijection of the block numbers, and each window of STREAMWINDOWBLOCKS blocks is shuffled. Peak memory is thus close to the
+ * size of the result.
+ * @param ninputs Number of inputs to the partially ordered network
+ * @param clusters Output pattern lists of the clusters, see computePrefixClusters
+ * @param use_symmetry Optimize using symmetry
+ * @param lanes Number of BPWord_t per line in a group (1..MAXLANES)
+ * @param rndgen Random number generator for the order of the patterns
+ * @param parallels [OUT] Bit parallel representations of the patterns
+ * @param verbosity Verbosity level, debug output is printed above 2
+ */
+void streamPrefixOutputs(u8 ninputs, const std::vector<SinglePatternList_t> &clusters, bool use_symmetry, u32 lanes, RandGen_t &rndgen, BitParallelList_t &parallels, u32 verbosity);
 
 /**
  * Tries to create a partially ordered network that (approximately) minimizes the number of possible outputs.
@@ -60,8 +116,28 @@ void convertToBitParallel(u8 ninputs, const SinglePatternList_t &singles, bool u
  * @param use_symmetry Set to true of the computed prefix needs to be symmetrical
  * @param prefix Contains fixed pairs as input (if any) and best prefix as output
  * @param rndgen Random number generator for shuffling
+ * @param verbosity Verbosity level, debug output is printed above 2
  * @return Number of outputs from partially ordered network (ninputs+1 if fully sorted, 2**ninputs worst case)
  */
-SortWord_t createGreedyPrefix(u8 ninputs, u32 maxpairs, bool use_symmetry, Network_t &prefix, RandGen_t &rndgen);
+SortWord_t createGreedyPrefix(u8 ninputs, u32 maxpairs, bool use_symmetry, Network_t &prefix, RandGen_t &rndgen, u32 verbosity);
+
+/**
+ * Creates a prefix like createGreedyPrefix, but with a beam search: every step, each of the beamwidth best partial prefixes is
+ * extended with every pair, and the beamwidth smallest extensions (by number of outputs) are kept. The search stops when no
+ * extension reduces the number of outputs or the maximum size is reached. The best extension of the state that followed the best
+ * extensions so far is always kept, so the beam holds a greedy prefix. With beamwidth 1, the result is that of createGreedyPrefix.
+ * With a depth limit, the beam search runs for at most beamdepth steps, after which only the first step towards the best state
+ * found is kept, and a new beam search starts from there.
+ * @param ninputs Number of inputs to the partially ordered network
+ * @param maxpairs Maximum number of pairs in the prefix
+ * @param use_symmetry Set to true of the computed prefix needs to be symmetrical
+ * @param beamwidth Number of partial prefixes kept in each step (>=1)
+ * @param beamdepth Number of steps to look ahead before committing to a step, 0 to search the whole prefix in one beam search
+ * @param prefix Contains fixed pairs as input (if any) and best prefix as output
+ * @param rndgen Random number generator for shuffling
+ * @param verbosity Verbosity level, debug output is printed above 2
+ * @return Number of outputs from partially ordered network
+ */
+SortWord_t createBeamPrefix(u8 ninputs, u32 maxpairs, bool use_symmetry, u32 beamwidth, u32 beamdepth, Network_t &prefix, RandGen_t &rndgen, u32 verbosity);
 
 #endif // _PREFIX_PROCESSOR_H_
@@ -0,0 +1,1473 @@
+/**
+ * @file search_context.cpp
+ * @brief Reentrant evolutionary search for sorting networks, used by the SorterHunter program
+ * @author Bert Dobbelaere bert.o.dobbelaere[at]telenet[dot]be
+ *
+ * Copyright (c) 2022 Bert Dobbelaere
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "search_context.h"
+#include "prefix_processor.h"
+#include "bdd_verifier.h"
+#include "thread_affinity.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+
+/**
+ * Full list of test vectors shared by searches and speculation workers. It is never modified: the testers reorder private copies
+ * of its leading groups. With ThreadAffinity, every NUMA node gets a copy of its own, so that pinned threads read local memory.
+ */
+struct SharedTestVectors_t {
+	std::mutex lock;          ///< Protects replicas
+	int home=-1;              ///< NUMA node of the thread that created list, -1 if not pinned
+	BitParallelList_t list;   ///< List as created
+	std::vector<std::unique_ptr<BitParallelList_t> > replicas; ///< Copy of list per NUMA node, made by the first thread of the node that uses it
+	
+	/**
+	 * List to be read by a thread of a NUMA node
+	 * @param node NUMA node of the thread, -1 if unknown
+	 * @param verbosity Verbosity level
+	 * @return The list, or its copy for the node
+	 */
+	const BitParallelList_t &forNode(int node, u32 verbosity)
+	{
+		if((node<0) || (home<0) || (node==home))
+			return list;
+		std::lock_guard<std::mutex> guard(lock);
+		if(replicas.size()<=(size_t)node)
+			replicas.resize(node+1);
+		if(!replicas[node])
+		{
+			replicas[node].reset(new BitParallelList_t(list)); // Pages are placed on the node of the copying thread
+			if(verbosity > 2)
+			{
+				printf("Debug: Copied %lu test vector words to NUMA node %d\n", list.size(), node);
+			}
+		}
+		return *replicas[node];
+	}
+};
+
+/**
+ * Filter a network to obtain only the pairs that are in range 0..ninputs-1 and properly sorted
+ * @param nw input network
+ * @param ninputs Number of inputs
+ * @return Filtered input network
+ */
+static Network_t copyValidPairs(const Network_t &nw, u32 ninputs)
+{
+	Network_t result;
+	for(Network_t::const_iterator it=nw.begin();it!=nw.end();it++)
+	{
+		if((it->hi < ninputs) && (it->lo < it->hi))
+		{
+			result.push_back( *it);
+		}
+	}
+	return result;
+}
+
+
+const char *const mutationWeightKeys[NMUTATIONTYPES]={"WeigthRemovePair","WeigthSwapPairs","WeigthReplacePair","WeightCrossPairs","WeightSwapIntersectingPairs","WeightReplaceHalfPair"};
+
+bool readSearchTuning(const ConfigParser &cp, SearchConfig_t &cfg)
+{
+	SearchConfig_t c=cfg;
+	c.EscapeRate = cp.getInt("EscapeRate",cfg.EscapeRate);
+	c.MaxMutations= cp.getInt("MaxMutations",cfg.MaxMutations);
+	u32 totalweight=0;
+	for(u32 n=0;n<NMUTATIONTYPES;n++)
+	{
+		c.mutation_type_weights[n]=cp.getInt(mutationWeightKeys[n],cfg.mutation_type_weights[n]);
+		totalweight+=c.mutation_type_weights[n];
+	}
+	if(totalweight==0)
+		return false;
+	cfg=c;
+	return true;
+}
+
+bool readSearchConfig(const ConfigParser &cp, SearchConfig_t &cfg)
+{
+	cfg=SearchConfig_t();
+	cfg.N=cp.getInt("Ninputs",0);
+	cfg.use_symmetry = (cp.getInt("Symmetric")>0u);
+	cfg.force_valid_uphill_step = (cp.getInt("ForceValidUphillStep",1)>0);
+	if(!readSearchTuning(cp, cfg))
+	{
+		printf("No mutation types selected.\n");
+		return false;
+	}
+	cfg.PrefixType=cp.getInt("PrefixType",0);
+	cfg.FixedPrefix=cp.getNetwork("FixedPrefix");
+	cfg.InitialNetwork=cp.getNetwork("InitialNetwork");
+	cfg.GreedyPrefixSize=cp.getInt("GreedyPrefixSize",0);
+	cfg.BeamWidth=cp.getInt("BeamWidth",8);
+	cfg.BeamWidth=std::max(1u,cfg.BeamWidth);
+	cfg.BeamDepth=cp.getInt("BeamDepth",0);
+	cfg.RandomSeed=cp.getInt("RandomSeed",0);
+	cfg.RestartRate=cp.getInt("RestartRate",0);
+	cfg.Verbosity=cp.getInt("Verbosity",1);
+	cfg.postfix=cp.getNetwork("Postfix");
+	cfg.ParallelWordBits=cp.getInt("ParallelWordBits",0);
+	cfg.CheckpointInterval=cp.getInt("CheckpointInterval",0);
+	cfg.CheckpointGroups=cp.getInt("CheckpointGroups",1);
+	cfg.BatchSize=cp.getInt("BatchSize",1);
+	cfg.BatchSize=std::max(1u,std::min(cfg.BatchSize,(u32)MAXBATCHSIZE));
+	cfg.PatternMajorThreshold=cp.getInt("PatternMajorThreshold",64);
+	cfg.LayeredSearch=(cp.getInt("LayeredSearch",0)>0);
+	cfg.TernaryTest=(cp.getInt("TernaryTest",0)>0);
+	cfg.TwoStageTest=(cp.getInt("TwoStageTest",0)>0);
+	cfg.SampleVectors=cp.getInt("SampleVectors",0);
+	cfg.SampleRefreshRate=cp.getInt("SampleRefreshRate",100000);
+	cfg.ChunkVectors=cp.getInt("ChunkVectors",65536);
+	cfg.FailureCacheVectors=cp.getInt("FailureCacheVectors",0);
+	cfg.PruneInactive=(cp.getInt("PruneInactive",1)>0);
+	cfg.MaxTestVectors=cp.getInt("MaxTestVectors",0);
+	cfg.VerifyBDD=(cp.getInt("VerifyBDD",0)>0);
+	cfg.BDDMaxNodes=cp.getInt("BDDMaxNodes",1u<<22);
+	cfg.Threads=cp.getInt("Threads",1);
+	if(cfg.Threads==0)
+	{
+		cfg.Threads=std::max(1u, std::thread::hardware_concurrency());
+	}
+	cfg.MigrationInterval=cp.getInt("MigrationInterval",1000000);
+	cfg.SpeculativeThreads=cp.getInt("SpeculativeThreads",1);
+	if(cfg.SpeculativeThreads==0)
+	{
+		cfg.SpeculativeThreads=std::max(1u, std::thread::hardware_concurrency());
+	}
+	cfg.ThreadAffinity=(cp.getInt("ThreadAffinity",0)>0);
+	cfg.ControlSocket=cp.getString("ControlSocket");
+	
+	if((cfg.N%2) && cfg.use_symmetry)
+	{
+		if(cfg.Verbosity > 0)
+		{
+			printf("Warning: option 'Symmetric' ignored for odd number of inputs\n");
+		}
+		cfg.use_symmetry = false;
+	}
+	return true;
+}
+
+/**
+ * Select the test kernel and configure the tester. Settings that default to a number of kernel words are resolved here.
+ */
+void SearchContext::setupTester()
+{
+	u32 lanes=tester.selectTestKernel(cfg.N, cfg.ParallelWordBits);
+	tester.setNetworkExpansion(cfg.use_symmetry, cfg.postfix);
+	tester.configurePatternMajor(cfg.PatternMajorThreshold);
+	tester.configureCheckpoints(cfg.CheckpointInterval, cfg.CheckpointGroups);
+	if(cfg.FailureCacheVectors==0)
+	{
+		cfg.FailureCacheVectors=lanes*PARWORDSIZE;
+	}
+	if(cfg.SampleVectors==0)
+	{
+		cfg.SampleVectors=4*lanes*PARWORDSIZE;
+	}
+}
+
+/**
+ * Take over the prefix and the test vectors of another search. A shared full list of test vectors is used without copying it,
+ * otherwise the test vectors are prepared from the prefix.
+ * @param source Search with the same settings
+ */
+void SearchContext::followTestVectors(const SearchContext &source)
+{
+	prefix=source.prefix;
+	if(source.sourcepatterns)
+	{
+		useSharedTestVectors(source.sourcepatterns);
+	}
+	else
+	{
+		prepareTestVectorsFromPrefix(prefix);
+	}
+}
+
+/**
+ * Draw a new random sample of prefix outputs as first stage test vectors (TwoStageTest)
+ */
+void SearchContext::refreshSample()
+{
+	SinglePatternList_t sample;
+	samplePrefixOutputs(prefixclusters, cfg.SampleVectors, mtRand, sample);
+	tester.refreshTestVectors(cfg.N, sample, parallelpatterns_from_prefix);
+}
+
+/**
+ * Draw a new sample of prefix outputs with inverse probability SampleRefreshRate per candidate (TwoStageTest)
+ * @param ncandidates Number of candidates tested since the last call
+ */
+void SearchContext::maybeRefreshSample(u32 ncandidates)
+{
+	if(cfg.TwoStageTest && !cfg.TernaryTest && (cfg.SampleRefreshRate>0) && (mtRand.below(cfg.SampleRefreshRate)<ncandidates))
+	{
+		refreshSample();
+	}
+}
+
+/**
+ * Use a full list of test vectors that is shared with other searches or threads, see shareTestVectors.
+ * With ThreadAffinity, the copy of the list on the NUMA node of the calling thread is used.
+ * @param shared List of test vectors
+ */
+void SearchContext::useSharedTestVectors(const std::shared_ptr<SharedTestVectors_t> &shared)
+{
+	const BitParallelList_t &list=shared->forNode(cfg.ThreadAffinity ? currentNumaNode() : -1, cfg.Verbosity);
+	if(tester.shareTestVectors(cfg.N, list, parallelpatterns_from_prefix) && (cfg.Verbosity > 2))
+	{
+		printf("Debug: Using pattern-major test kernel\n");
+	}
+	sourcepatterns=shared;
+	testvectorversion++;
+}
+
+/**
+ * Initialise test vectors with patterns produced by the prefix.
+ * Test vectors are stored in parallelpatterns_from_prefix
+ * @param prefix Network prefix to use
+ */
+void SearchContext::prepareTestVectorsFromPrefix(const Network_t &prefix)
+{
+	bool is_even = ((cfg.N%2)==0);
+	bool ternary=cfg.TernaryTest;
+	prefixclusters.clear();
+	ternaryfallback=false;
+	sourcepatterns.reset();
+	testvectorversion++;
+	
+	if(!ternary && !cfg.TwoStageTest && (cfg.MaxTestVectors>0))
+	{
+		computePrefixClusters(cfg.N, prefix, prefixclusters);
+		uint64_t count=countPrefixOutputs(prefixclusters);
+		if(count>cfg.MaxTestVectors)
+		{
+			if(cfg.Verbosity > 1)
+			{
+				printf("Prefix leaves %lu output patterns, using ternary test\n", count);
+			}
+			ternary=true;
+			ternaryfallback=true; // Reported networks get an independent check of what the ternary test accepts
+		}
+	}
+	
+	if(ternary || cfg.TwoStageTest)
+	{
+		// Start with an empty test vector list, which collects failing vectors found by the second stage
+		if(prefixclusters.empty())
+		{
+			computePrefixClusters(cfg.N, prefix, prefixclusters);
+		}
+		parallelpatterns_from_prefix.clear();
+		tester.setTestVectors(cfg.N, parallelpatterns_from_prefix);
+		if(ternary)
+		{
+			tester.setTernaryClusters(prefixclusters, cfg.FailureCacheVectors);
+		}
+		else
+		{
+			tester.setExhaustiveClusters(cfg.N, prefixclusters, cfg.ChunkVectors, cfg.FailureCacheVectors);
+			refreshSample();
+		}
+		if(cfg.Verbosity > 2)
+		{
+			printf("Debug: %s test with %u line clusters\n", ternary ? "Ternary" : "Two-stage", (u32)prefixclusters.size());
+		}
+		return;
+	}
+	
+	// The output patterns are generated in a pseudorandom order: improves probability of early rejection of non-sorters
+	std::vector<SinglePatternList_t> clusters;
+	if(prefixclusters.empty())
+	{
+		computePrefixClusters(cfg.N, prefix, clusters);
+	}
+	const std::vector<SinglePatternList_t> &source=prefixclusters.empty() ? clusters : prefixclusters;
+
+	if(sharevectors)
+	{
+		// Shared with other islands or with the speculation workers
+		std::shared_ptr<SharedTestVectors_t> shared=std::make_shared<SharedTestVectors_t>();
+		shared->home=cfg.ThreadAffinity ? currentNumaNode() : -1;
+		streamPrefixOutputs(cfg.N, source, cfg.use_symmetry && is_even, tester.testKernelLanes(), mtRand, shared->list, cfg.Verbosity);
+		useSharedTestVectors(shared);
+		return;
+	}
+	streamPrefixOutputs(cfg.N, source, cfg.use_symmetry && is_even, tester.testKernelLanes(), mtRand, parallelpatterns_from_prefix, cfg.Verbosity);
+	if(tester.setTestVectors(cfg.N, parallelpatterns_from_prefix) && (cfg.Verbosity > 2))
+	{
+		printf("Debug: Using pattern-major test kernel\n");
+	}
+}
+
+/**
+ * Create the network to be tested from a core network: symmetric expansion (or just a copy if non-symmetric network), followed by the postfix.
+ * @param core Core network
+ * @param nw [OUT] Expanded network
+ */
+void SearchContext::expandNetwork(const Network_t &core, Network_t &nw) const
+{
+	if(cfg.use_symmetry)
+	{
+		symmetricExpansion(cfg.N, core, nw);
+	}
+	else
+	{
+		nw=core;
+	}
+	appendNetwork(nw,cfg.postfix);
+}
+
+/**
+ * Number of CEs in a core network after symmetric expansion
+ * @param core Core network
+ * @return Number of CEs
+ */
+size_t SearchContext::mirroredSize(const Network_t &core) const
+{
+	size_t n=core.size();
+	if(cfg.use_symmetry)
+	{
+		for(size_t k=0;k<core.size();k++)
+		{
+			if((core[k].lo+core[k].hi)!=(cfg.N-1)) // Mirrored pair
+				n++;
+		}
+	}
+	return n;
+}
+
+/**
+ * Size of the network created by expandNetwork, without creating it
+ * @param core Core network
+ * @return Number of CEs in the expanded network
+ */
+size_t SearchContext::expandedSize(const Network_t &core) const
+{
+	return mirroredSize(core)+cfg.postfix.size();
+}
+
+/**
+ * Size of the network created by expandNetwork from a layered core network, without creating it
+ * @param nl Layered core network
+ * @return Number of CEs in the expanded network
+ */
+size_t SearchContext::expandedSize(const LayeredNetwork_t &nl) const
+{
+	size_t n=cfg.postfix.size();
+	for(size_t l=0;l<nl.size();l++)
+	{
+		n+=mirroredSize(nl[l].ces);
+	}
+	return n;
+}
+
+/**
+ * Initialize "alphabet" of CEs to use
+ */
+
+void SearchContext::initalphabet()
+{
+	alphabet.clear();
+	for(u32 i=0;i<(cfg.N-1u);i++)
+		for(u32 j=i+1;j<cfg.N;j++)
+		{
+			u32 isym=cfg.N-1-j;
+			u32 jsym=cfg.N-1-i;
+			
+			if(!cfg.use_symmetry || (isym>i) || ((isym==i) && (jsym>=j)))
+			{
+				Pair_t p={(u8)i,(u8)j};
+				alphabet.push_back(p);
+			}	
+		}
+}		
+
+/**
+ * Create a prefix network using greedy algorithm A.
+ * @param prefix [OUT] generated prefix
+ * @param npairs Number of inputs to the network
+ */
+void SearchContext::fillprefixGreedyA(Network_t &prefix, u32 npairs)
+{
+	prefix.clear();
+	SortWord_t sizetmp=createGreedyPrefix(cfg.N, npairs, cfg.use_symmetry, prefix, mtRand, cfg.Verbosity);
+	if( cfg.Verbosity > 1)
+	{
+		printf("Greedy prefix size %lu, span %lu.\n",prefix.size(),(size_t)sizetmp);
+	}
+}
+
+/**
+ * Create a hybrid prefix network using first the fixed prefix, then append elements with greedy algorithm A.
+ * @param prefix [OUT] generated prefix
+ * @param npairs Number of inputs to the network
+ */
+void SearchContext::fillprefixFixedThenGreedyA(Network_t &prefix, u32 npairs)
+{
+	prefix=copyValidPairs(cfg.FixedPrefix, cfg.N);
+	SortWord_t sizetmp=createGreedyPrefix(cfg.N, npairs+prefix.size(), cfg.use_symmetry, prefix, mtRand, cfg.Verbosity);
+	if( cfg.Verbosity > 2)
+	{
+		printf("Hybrid prefix size %lu, span %lu.\n",prefix.size(),(size_t)sizetmp);
+	}
+}
+
+/**
+ * Create a prefix network with a beam search of width BeamWidth, looking BeamDepth steps ahead.
+ * @param prefix [OUT] generated prefix
+ * @param npairs Number of inputs to the network
+ */
+void SearchContext::fillprefixBeam(Network_t &prefix, u32 npairs)
+{
+	prefix.clear();
+	SortWord_t sizetmp=createBeamPrefix(cfg.N, npairs, cfg.use_symmetry, cfg.BeamWidth, cfg.BeamDepth, prefix, mtRand, cfg.Verbosity);
+	if( cfg.Verbosity > 1)
+	{
+		printf("Beam search prefix size %lu, span %lu.\n",prefix.size(),(size_t)sizetmp);
+	}
+}
+
+
+/**
+ * Attempt to apply a single mutation to the network. If the mutation is a priory rejected, 0 is returned and we will try again.
+ * @param newpairs [IN/OUT] candidate network
+ * @param unmodified newpairs is still equal to the accepted network, so that the swap counts in activity apply to its pairs
+ * @return Positive integer identifying type of mutation applied, or 0 if none.
+ */
+u32 SearchContext::attemptMutation(Network_t &newpairs, bool unmodified)
+{
+	u32 applied=0; // Nothing
+	u32 mtype=1+RANDELEM(mutationSelector);
+	
+	switch(mtype)
+	{
+		case 1:		
+			if(newpairs.size()>0)   // Removal of random pair from list
+			{
+				u32 a=RANDIDX(newpairs);
+				if(unmodified && (activity.size()==newpairs.size()))
+				{
+					// Out of two random pairs, remove the one that swaps on fewer test vectors
+					u32 b=RANDIDX(newpairs);
+					if(activity[b]<activity[a])
+						a=b;
+				}
+				newpairs.erase(newpairs.begin() + a);
+				applied=mtype;
+			}
+			break;
+		case 2:
+			if(newpairs.size()>1) // Swap two pairs at random positions in list
+			{
+				u32 a=RANDIDX(newpairs);
+				u32 b=RANDIDX(newpairs);
+				if(a>b){u32 z=a;a=b;b=z;}
+				if(newpairs[a]!=newpairs[b])
+				{
+					bool dependent=false;
+					u8 alo=newpairs[a].lo;
+					u8 ahi=newpairs[a].hi;
+					u8 blo=newpairs[b].lo;
+					u8 bhi=newpairs[b].hi;
+					
+					// Pairs should either intersect, or another pair should exist between them that uses
+					// one of the same 4 inputs. Otherwise, comparisons can be executed in parallel and
+					// swapping them has no effect. 
+					if((blo==alo)||(blo==ahi)||(bhi==alo)||(bhi==ahi))
+						dependent=true;
+					else
+					{
+						for(u32 k=a+1;k<b;k++)
+						{
+							u8 clo=newpairs[k].lo;
+							u8 chi=newpairs[k].hi;
+							if((clo==alo)||(clo==ahi)||(chi==alo)||(chi==ahi)||
+							   (clo==blo)||(clo==bhi)||(chi==blo)||(chi==bhi))
+							{
+								dependent=true;
+								break;
+							}
+						}
+					}
+					if(dependent)
+					{			
+						Pair_t z=newpairs[a];
+						newpairs[a]=newpairs[b];
+						newpairs[b]=z;
+						applied=mtype;
+					}
+				}
+			}
+			break;
+		case 3:		
+			if(newpairs.size()>0)  // Replace a pair at a random position with another random pair
+			{
+				u32 a=RANDIDX(newpairs);
+				Pair_t p=RANDELEM(alphabet);
+				if(newpairs[a]!=p)
+				{
+					newpairs[a]=p;
+					applied=mtype;
+				}
+			}
+			break;
+		case 4:
+			if(newpairs.size()>1) // Cross two pairs at random positions in list
+			{
+				u32 a=RANDIDX(newpairs);
+				u32 b=RANDIDX(newpairs);
+				u8 alo=newpairs[a].lo;
+				u8 ahi=newpairs[a].hi;
+				u8 blo=newpairs[b].lo;
+				u8 bhi=newpairs[b].hi;
+				
+				if ((alo!=blo)&&(alo!=bhi)&&(ahi!=blo)&&(ahi!=bhi))
+				{
+					u32 r2=mtRand.below(2);
+					u32 x = r2 ? bhi : blo;
+					u32 y = r2 ? blo : bhi;
+					newpairs[a].lo = min(alo, x);
+					newpairs[a].hi = max(alo, x);
+					newpairs[b].lo = min(ahi, y);
+					newpairs[b].hi = max(ahi, y);
+					applied=mtype;
+				}
+			}
+			break;
+		case 5:
+			if(newpairs.size()>1) // Swap neighbouring intersecting pairs - special case of type r=2.
+			{
+				u32 a=RANDIDX(newpairs);
+				u8 alo=newpairs[a].lo;
+				u8 ahi=newpairs[a].hi;
+				for(u32 b=a+1;b<newpairs.size();b++)
+				{
+					u8 blo=newpairs[b].lo;
+					u8 bhi=newpairs[b].hi;
+					if((blo==alo)||(blo==ahi)||(bhi==alo)||(bhi==ahi))
+					{
+						if(newpairs[a]!=newpairs[b])
+						{
+							Pair_t z=newpairs[a];
+							newpairs[a]=newpairs[b];
+							newpairs[b]=z;
+							applied=mtype;
+						}
+						break;
+					}
+				}		
+			}
+			break;
+		case 6:
+			if(newpairs.size()>0) // Change one half of a pair - special case of type r=3.
+			{
+				u32 a=RANDIDX(newpairs);
+				Pair_t p=newpairs[a];
+				Pair_t q;
+				do {
+					q=RANDELEM(alphabet);
+					}while((q.lo!=p.lo)&&(q.hi!=p.lo)&&(q.lo!=p.hi)&&(q.hi!=p.hi));
+					
+				if(q!=p)
+				{
+					newpairs[a]=q;
+					applied=mtype;
+				}
+			}
+			break;
+		default:
+			break;
+	}
+	
+	return applied;
+}
+
+/**
+ * Remove a CE from a layer of a layered network, and the layer itself if it becomes empty
+ * @param nl [IN/OUT] Layered network
+ * @param l Layer index
+ * @param k CE index within the layer
+ */
+void SearchContext::removeLayerCE(LayeredNetwork_t &nl, u32 l, u32 k) const
+{
+	Layer_t &layer=nl[l];
+	layer.lines&=~ceLines(cfg.N, cfg.use_symmetry, layer.ces[k]);
+	layer.ces.erase(layer.ces.begin()+k);
+	if(layer.ces.empty())
+	{
+		nl.erase(nl.begin()+l);
+	}
+}
+
+/**
+ * Layered counterpart of attemptMutation. The same mutation weights are used, for operations within or between layers:
+ * 1: remove a CE, 2: move a CE to another layer, 3: replace a CE, 4: cross two CEs of a layer,
+ * 5: swap neighbouring layers that share lines, 6: change one half of a CE.
+ * Mutations keep the CEs of each layer on disjoint lines.
+ * @param nl [IN/OUT] candidate layered network
+ * @return Positive integer identifying type of mutation applied, or 0 if none.
+ */
+u32 SearchContext::attemptLayerMutation(LayeredNetwork_t &nl)
+{
+	u32 applied=0; // Nothing
+	u32 mtype=1+RANDELEM(mutationSelector);
+	
+	if(nl.size()==0)
+	{
+		return 0;
+	}
+	
+	u32 l=RANDIDX(nl);
+	Layer_t &layer=nl[l];
+	u32 k=RANDIDX(layer.ces);
+	Pair_t p=layer.ces[k];
+	SortWord_t plines=ceLines(cfg.N, cfg.use_symmetry, p);
+	
+	switch(mtype)
+	{
+		case 1: // Removal of random CE
+			removeLayerCE(nl, l, k);
+			applied=mtype;
+			break;
+		case 2: // Move a CE to another layer where its lines are free
+			{
+				u32 l2=RANDIDX(nl);
+				if((l2!=l) && ((nl[l2].lines & plines)==0))
+				{
+					nl[l2].ces.push_back(p);
+					nl[l2].lines|=plines;
+					removeLayerCE(nl, l, k);
+					applied=mtype;
+				}
+			}
+			break;
+		case 3: // Replace a CE with a random CE that fits in the layer
+			{
+				Pair_t q=RANDELEM(alphabet);
+				SortWord_t qlines=ceLines(cfg.N, cfg.use_symmetry, q);
+				if((q!=p) && (((layer.lines & ~plines) & qlines)==0))
+				{
+					layer.ces[k]=q;
+					layer.lines=(layer.lines & ~plines) | qlines;
+					applied=mtype;
+				}
+			}
+			break;
+		case 4: // Cross two CEs of the same layer
+			if(layer.ces.size()>1)
+			{
+				u32 k2=RANDIDX(layer.ces);
+				if(k2!=k)
+				{
+					Layer_t old=layer;
+					Pair_t q=layer.ces[k2];
+					u32 r2=mtRand.below(2);
+					u32 x = r2 ? q.hi : q.lo;
+					u32 y = r2 ? q.lo : q.hi;
+					layer.ces[k].lo = min(p.lo, x);
+					layer.ces[k].hi = max(p.lo, x);
+					layer.ces[k2].lo = min(p.hi, y);
+					layer.ces[k2].hi = max(p.hi, y);
+					if(computeLayerLines(cfg.N, cfg.use_symmetry, layer)) // Mirror images may collide in symmetric networks
+					{
+						applied=mtype;
+					}
+					else
+					{
+						layer=old;
+					}
+				}
+			}
+			break;
+		case 5: // Swap neighbouring layers, if they share lines
+			if((l+1)<nl.size())
+			{
+				if(nl[l].lines & nl[l+1].lines)
+				{
+					std::swap(nl[l], nl[l+1]);
+					applied=mtype;
+				}
+			}
+			break;
+		case 6: // Change one half of a CE
+			{
+				Pair_t q;
+				do {
+					q=RANDELEM(alphabet);
+					}while((q.lo!=p.lo)&&(q.hi!=p.lo)&&(q.lo!=p.hi)&&(q.hi!=p.hi));
+				
+				SortWord_t qlines=ceLines(cfg.N, cfg.use_symmetry, q);
+				if((q!=p) && (((layer.lines & ~plines) & qlines)==0))
+				{
+					layer.ces[k]=q;
+					layer.lines=(layer.lines & ~plines) | qlines;
+					applied=mtype;
+				}
+			}
+			break;
+		default:
+			break;
+	}
+	
+	return applied;
+}
+
+/**
+ * Create a batch of BatchSize candidates, each one a mutated copy of the accepted network (pairs or layers)
+ */
+void SearchContext::createBatch()
+{
+	if(cfg.LayeredSearch)
+		batchlayers.resize(cfg.BatchSize);
+	else
+		batchpairs.resize(cfg.BatchSize);
+	for(u32 m=0;m<cfg.BatchSize;m++)
+	{
+		/* Determine number of mutations to use for this candidate */
+		u32 nmods=1;
+
+		if(cfg.MaxMutations>1)
+		{
+			nmods += mtRand.below(cfg.MaxMutations);
+		}
+		
+		if(cfg.LayeredSearch)
+			batchlayers[m]=layers;
+		else
+			batchpairs[m]=pairs;
+		
+		/* Apply the mutations */
+		u32 modcount=0;
+		while(modcount<nmods)
+		{
+			u32 r=cfg.LayeredSearch ? attemptLayerMutation(batchlayers[m]) : attemptMutation(batchpairs[m], modcount==0);
+			if(r!=0)
+			{
+				modcount++;
+			}
+		}
+	}
+}
+
+/**
+ * Size of a candidate of the batch after expansion
+ * @param m Candidate index
+ * @return Number of CEs in the expanded network
+ */
+size_t SearchContext::candidateSize(u32 m) const
+{
+	return cfg.LayeredSearch ? expandedSize(batchlayers[m]) : expandedSize(batchpairs[m]);
+}
+
+/**
+ * Select the smallest valid candidate of the tested batch, the first one in case of a tie. Layered candidates of equal size are ranked by depth of the core network.
+ * @param bestsize [OUT] Size of the selected candidate after expansion
+ * @return Index of the selected candidate, -1 if none is valid
+ */
+int SearchContext::selectCandidate(size_t &bestsize) const
+{
+	int best=-1;
+	bestsize=0;
+	for(u32 m=0;m<cfg.BatchSize;m++)
+	{
+		if(batchvalid[m])
+		{
+			size_t sz=candidateSize(m);
+			if((sz>0) && ((best<0) || (sz<bestsize) || (cfg.LayeredSearch && (sz==bestsize) && (batchlayers[m].size()<batchlayers[best].size()))))
+			{
+				best=m;
+				bestsize=sz;
+			}
+		}
+	}
+	return best;
+}
+
+/**
+ * Compute the activity of the CEs of the current core network, and remove the CEs that never swap if the test vectors cover
+ * all outputs of the prefix (and PruneInactive is set). Networks that grew by uphill steps (see EscapeRate) beyond the smallest
+ * size since the last restart are not pruned, as that would undo the escape.
+ */
+void SearchContext::pruneInactive()
+{
+	if(!tester.computeActivity(cfg.N, pairs, parallelpatterns_from_prefix, activity) || !cfg.PruneInactive || (pairs.size()>prunelevel))
+		return;
+	
+	size_t n=0;
+	for(size_t k=0;k<pairs.size();k++)
+	{
+		if(activity[k]>0)
+		{
+			pairs[n]=pairs[k];
+			activity[n]=activity[k];
+			n++;
+		}
+	}
+	prunelevel=n;
+	if(n==pairs.size())
+		return;
+	
+	if(cfg.Verbosity > 2)
+	{
+		printf("Debug: Removed %lu inactive pairs\n", pairs.size()-n);
+	}
+	pairs.resize(n);
+	activity.resize(n);
+	if(cfg.LayeredSearch)
+	{
+		layerNetwork(cfg.N, cfg.use_symmetry, pairs, layers);
+		flattenLayers(layers, pairs);
+		tester.computeActivity(cfg.N, pairs, parallelpatterns_from_prefix, activity);
+	}
+}
+
+/**
+ * Report sorting network if it is an improved (size,depth) combination
+ * @param nw Valid sorting network
+ */
+void SearchContext::checkImproved(const Network_t &nw)
+{
+	u32 depth=computeDepth(nw);
+	std::unique_lock<std::mutex> guard(archive->lock);
+	if((cfg.VerifyBDD || ternaryfallback) && archive->conv_hull.wouldImprove(nw.size(),depth))
+	{
+		guard.unlock(); // Other searches can go on reporting during the verification
+		SortWord_t failed_input;
+		BDDResult_t result=verifySorterBDD(cfg.N, nw, cfg.BDDMaxNodes, &failed_input);
+		if(result==BDD_NOT_SORTER)
+		{
+			printf("Error: BDD verification failed, network does not sort input 0x%llx\n", (unsigned long long)failed_input);
+			return;
+		}
+		if((result==BDD_TOO_LARGE) && (cfg.Verbosity > 1))
+		{
+			printf("Warning: BDD node limit reached, network not verified\n");
+		}
+		guard.lock();
+	}
+	if(archive->conv_hull.improved(nw.size(),depth))
+	{
+		if(archive->report)
+		{
+			archive->report(nw, depth, prefix.size());
+		}
+		else
+		{
+			printNetworkReport(cfg, nw, depth, prefix.size(), archive->conv_hull);
+		}
+	}
+}
+
+void printNetworkReport(const SearchConfig_t &cfg, const Network_t &nw, u32 depth, size_t prefixsize, const OCH_t &conv_hull)
+{
+	/* Print only if the sorter is an improved (size,depth) combination */
+	if((cfg.Verbosity > 1) || (nw.size() <= ((cfg.N*(cfg.N-1u))/2u))) // Reduce rubbish listing. Should at least compete with bubble sort before reporting
+	{
+		flockfile(stdout); // Keep the report together when other islands print
+		printf(" {'N':%u,'L':%lu,'D':%u,'sw':'%s','ESC':%u,'Prefix':%lu,'Postfix':%lu,'nw':",cfg.N,nw.size(),depth,VERSION,cfg.EscapeRate,prefixsize,cfg.postfix.size());
+		printnw(nw); 
+		conv_hull.print();
+		funlockfile(stdout);
+	}
+}
+
+/**
+ * Accept the current core network: prune it, make it the reference network of the testers and report it if it is an improvement
+ */
+void SearchContext::acceptNetwork()
+{
+	Network_t totalnw;
+	pruneInactive();
+	expandNetwork(pairs, se);
+	concatNetwork(prefix,se,totalnw);
+	tester.setReferenceNetwork(cfg.N, pairs, parallelpatterns_from_prefix);
+	checkImproved(totalnw);
+}
+
+
+bool SearchContext::offerNetwork(const Network_t &nw)
+{
+	if(nw.empty() || (expandedSize(nw)>=expandedSize(pairs)))
+		return false;
+	return injectNetwork(nw);
+}
+
+bool SearchContext::injectNetwork(const Network_t &nw)
+{
+	// Searches may have different prefixes after a restart, so the network has to pass the test vectors of this search
+	Network_t core=copyValidPairs(nw, cfg.N);
+	if(!tester.testpairsFromPrefixOutput(cfg.N, core, parallelpatterns_from_prefix))
+		return false;
+	
+	pairs=core;
+	if(cfg.LayeredSearch)
+	{
+		layerNetwork(cfg.N, cfg.use_symmetry, pairs, layers);
+		flattenLayers(layers, pairs);
+	}
+	prunelevel=pairs.size();
+	acceptNetwork();
+	return true;
+}
+
+/*
+ * Speculative evaluation (SpeculativeThreads>1): worker threads generate and test mutants of the network of one lineage (a search).
+ * In each round, every worker tests BatchSize mutants drawn from its own random stream, which jumps ahead from the one of the lineage.
+ * The lineage accepts the smallest valid mutant, the one of the lowest worker index in case of a tie. A worker skips
+ * testing when all its mutants are larger than a valid mutant found in the round. The accepted network thus only depends on the
+ * seeds, and runs with a RandomSeed can be replayed.
+ * Each worker is a search of its own (without prefix), that follows the network and the test vectors of the lineage.
+ */
+
+/**
+ * Result of a speculation worker for one round
+ */
+struct SpeculationResult_t {
+	int best;                  ///< Index of the smallest valid mutant of the worker, -1 if none
+	size_t size;               ///< Size of that mutant after expansion
+	Network_t *pairs;          ///< That mutant (not LayeredSearch)
+	LayeredNetwork_t *layers;  ///< That mutant (LayeredSearch)
+};
+
+/**
+ * Speculation workers of a lineage
+ */
+struct Speculation_t {
+	std::mutex lock;                          ///< Protects all members, except bestsize
+	std::condition_variable wake;             ///< Signals the start of a round (or the end of the search) to the workers
+	std::condition_variable finished;         ///< Signals the end of a round to the lineage
+	uint64_t round=0;                         ///< Number of rounds started
+	u32 busy=0;                               ///< Number of workers that did not finish the round
+	bool stop=false;                          ///< The workers have to return
+	const SearchContext *lineage=NULL;        ///< Search of the lineage, which waits for the end of the round
+	std::atomic<size_t> bestsize{0};          ///< Size of the smallest valid mutant found in the round
+	std::vector<SpeculationResult_t> results; ///< Results of the round, per worker
+	std::vector<SearchContext *> workers;     ///< Search of each worker
+	std::vector<std::thread> threads;         ///< Thread of each worker
+};
+
+/**
+ * Speculation worker thread: test a batch of mutants of the network of the lineage in each round, until the lineage stops.
+ * Runs on the search of the worker.
+ * @param sp Speculation workers of the lineage
+ * @param worker Worker index
+ */
+void SearchContext::speculationWorker(Speculation_t *sp, u32 worker)
+{
+	uint64_t round=0;
+	uint64_t version=0;
+	
+	if(cfg.ThreadAffinity)
+	{
+		pinThreadToNextCpu(); // Before following the test vectors, so that the private copies are made on the node of the worker
+	}
+	
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> guard(sp->lock);
+			sp->wake.wait(guard, [&]{ return (sp->round!=round) || sp->stop; });
+			if(sp->stop)
+				return;
+			round=sp->round;
+		}
+		
+		/* Follow the test vectors and the network of the lineage, which do not change during the round */
+		const SearchContext &lineage=*sp->lineage;
+		bool newvectors=(version!=lineage.testvectorversion);
+		if(newvectors)
+		{
+			version=lineage.testvectorversion;
+			followTestVectors(lineage);
+		}
+		if(tuningversion!=lineage.tuningversion)
+		{
+			retune(lineage.cfg);
+			tuningversion=lineage.tuningversion;
+		}
+		if(newvectors || (pairs!=lineage.pairs))
+		{
+			pairs=lineage.pairs;
+			layers=lineage.layers;
+			activity=lineage.activity;
+			tester.setReferenceNetwork(cfg.N, pairs, parallelpatterns_from_prefix);
+		}
+		
+		createBatch();
+		size_t smallest=candidateSize(0);
+		for(u32 m=1;m<cfg.BatchSize;m++)
+			smallest=std::min(smallest, candidateSize(m));
+		
+		SpeculationResult_t result={-1, 0, NULL, NULL};
+		if(smallest<=sp->bestsize)
+		{
+			if(cfg.LayeredSearch)
+				tester.testLayerBatchFromPrefixOutput(cfg.N, batchlayers, parallelpatterns_from_prefix, batchvalid);
+			else
+				tester.testBatchFromPrefixOutput(cfg.N, batchpairs, parallelpatterns_from_prefix, batchvalid);
+			result.best=selectCandidate(result.size);
+			if(result.best>=0)
+			{
+				if(cfg.LayeredSearch)
+					result.layers=&batchlayers[result.best];
+				else
+					result.pairs=&batchpairs[result.best];
+				size_t s=sp->bestsize;
+				while((result.size<s) && !sp->bestsize.compare_exchange_weak(s, result.size))
+					;
+			}
+		}
+		maybeRefreshSample(cfg.BatchSize);
+		
+		std::lock_guard<std::mutex> guard(sp->lock);
+		sp->results[worker]=result;
+		if(--sp->busy==0)
+			sp->finished.notify_one();
+	}
+}
+
+/**
+ * Run a round of the speculation workers, and take the selected mutant as network of the lineage
+ * @return true if a valid mutant was found, it replaced pairs (or layers for LayeredSearch)
+ */
+bool SearchContext::speculate()
+{
+	Speculation_t &sp=*speculation;
+	std::unique_lock<std::mutex> guard(sp.lock);
+	sp.lineage=this;
+	sp.bestsize=SIZE_MAX;
+	sp.busy=sp.results.size();
+	sp.round++;
+	sp.wake.notify_all();
+	sp.finished.wait(guard, [&]{ return sp.busy==0; });
+	
+	int winner=-1;
+	for(size_t w=0;w<sp.results.size();w++)
+	{
+		const SpeculationResult_t &r=sp.results[w];
+		if(r.best<0)
+			continue;
+		if((winner<0) || (r.size<sp.results[winner].size) || (cfg.LayeredSearch && (r.size==sp.results[winner].size) && (r.layers->size()<sp.results[winner].layers->size())))
+			winner=w;
+	}
+	if(winner<0)
+		return false;
+	if(cfg.LayeredSearch)
+		layers.swap(*sp.results[winner].layers);
+	else
+		pairs.swap(*sp.results[winner].pairs);
+	return true;
+}
+
+/**
+ * Start over from the initial network, completed with random pairs until it is a valid sorter with the prefix
+ */
+void SearchContext::startNetwork()
+{
+	pairs=copyValidPairs(cfg.InitialNetwork,cfg.N);
+	
+	// Produce initial solution, simply by adding random pairs until we found a valid network. In case no postfix is present, we demand that the added pair
+	// fixes at least one of the output inversions in the first detected error output vector, so it does at least some useful work to help sorting the outputs.
+	// In case there is a postfix network, this check is not implemented.
+	for(;;)
+	{
+		SortWord_t failed_output_pattern;
+		
+		if(tester.testInitialPairsFromPrefixOutput(cfg.N, pairs, parallelpatterns_from_prefix, failed_output_pattern))
+			break;
+		
+		Pair_t p;
+		
+		if(cfg.postfix.size() == 0) // Empty postfix: find a pattern that fixes an arbitrary inversion in the first failed output
+		{
+			bool found_useful_ce=false;
+			do {
+				p = RANDELEM(alphabet);
+				
+				if ( (((failed_output_pattern>>p.lo)&1)==1) && (((failed_output_pattern>>p.hi)&1)==0) )
+					found_useful_ce = true;
+					
+				if(cfg.use_symmetry)
+				{
+					if ( (((failed_output_pattern>>((cfg.N-1)-p.hi))&1)==1) && (((failed_output_pattern>>((cfg.N-1)-p.lo))&1)==0) )
+						found_useful_ce = true;			
+				}
+				
+			}while( !found_useful_ce );
+		}
+		else // In case of postfix: just append a random initial pair to the core network, cannot directly determine good candidate from failed output pattern.
+		{
+			p = RANDELEM(alphabet); 
+		}
+		
+		pairs.push_back( p );
+	}
+
+	Network_t totalnw;
+	if(cfg.LayeredSearch)
+	{
+		layerNetwork(cfg.N, cfg.use_symmetry, pairs, layers);
+		flattenLayers(layers, pairs);
+	}
+	prunelevel=pairs.size();
+	pruneInactive();
+	expandNetwork(pairs, se);
+	concatNetwork(prefix,se,totalnw);
+	tester.setReferenceNetwork(cfg.N, pairs, parallelpatterns_from_prefix);
+
+	if(cfg.Verbosity>1)
+	{
+		printf("Initial network size: %lu\n",totalnw.size());
+	}
+	
+	checkImproved(totalnw);
+}
+
+/**
+ * Evolve the network by one iteration: test a batch of mutants (per speculation worker) and accept the best valid one,
+ * then maybe take an uphill step or restart
+ */
+void SearchContext::iterate()
+{
+	if(cfg.Verbosity>2)
+	{
+		itercount+=candidates;
+		if(itercount >= iter_next_report)
+		{
+			clock_t t2 = clock();
+			
+			if((t2>t1)&&(t2>t0))
+			{
+				double t=(t2-t0)/(double)CLOCKS_PER_SEC;
+				double dt=(t2-t1)/(double)CLOCKS_PER_SEC;
+				printf("Iteration %lu  t=%.3lf s     %.1lf it/s\n", itercount, t,  (itercount-iter_last_report)/dt ); 
+			}
+			
+			t1=t2;
+			iter_last_report = itercount;
+			iter_next_report = itercount + (1 + itercount/10); // Report about each 10% increase of iteration count, avoid all too frequent output
+		}
+	}
+	
+	bool accepted;
+	if(speculation)
+	{
+		accepted=speculate();
+	}
+	else
+	{
+		createBatch();
+		
+		/* Test which of the new postfix networks yield a valid sorter when combined with the prefix. The testers apply the symmetric expansion and the postfix on the fly. */
+		if(cfg.LayeredSearch)
+			tester.testLayerBatchFromPrefixOutput(cfg.N, batchlayers, parallelpatterns_from_prefix, batchvalid);
+		else
+			tester.testBatchFromPrefixOutput(cfg.N, batchpairs, parallelpatterns_from_prefix, batchvalid);
+		
+		size_t bestsize;
+		int best=selectCandidate(bestsize);
+		accepted=(best>=0);
+		if(accepted)
+		{
+			if(cfg.LayeredSearch)
+				layers.swap(batchlayers[best]);
+			else
+				pairs.swap(batchpairs[best]);
+		}
+	}
+	
+	stats.candidates+=candidates;
+	if(accepted)
+	{
+		if(cfg.LayeredSearch)
+		{
+			flattenLayers(layers, pairs);
+		}
+		stats.accepted++;
+		acceptNetwork();
+	}
+
+	/* With low probability, add another pair random pair at a random place. Attempt to escape from local optimum. */
+	if((cfg.EscapeRate>0) && (mtRand.below(cfg.EscapeRate)<candidates))
+	{
+		int a=mtRand.below(pairs.size()+1); // Random insertion position
+		Pair_t p = RANDELEM(alphabet);
+
+		// Determine if the random pair p could be added in the last layer
+		bool hit_successor = false;
+		for(Network_t::const_iterator it=pairs.begin()+a; it!= pairs.end() ; it++)
+		{
+			if((it->lo==p.lo)||(it->hi==p.lo)||(it->lo==p.hi)||(it->hi==p.hi))
+			{
+				hit_successor = true;
+				break;
+			}
+		}
+
+		if(cfg.force_valid_uphill_step && hit_successor)
+		{
+			pairs.insert(pairs.begin()+a, pairs[a]); // Prepend duplicate of existing pair right in front of it => Sorter with redundant pair will remain valid
+		}
+		else
+		{
+			pairs.insert(pairs.begin()+a, p); // Add random pair at the end of the network
+		}
+		if(cfg.LayeredSearch)
+		{
+			layerNetwork(cfg.N, cfg.use_symmetry, pairs, layers);
+			flattenLayers(layers, pairs);
+		}
+		activity.clear(); // Recomputed when the next candidate is accepted
+		tester.setReferenceNetwork(cfg.N, pairs, parallelpatterns_from_prefix);
+	}
+	
+	maybeRefreshSample(candidates);
+
+	if(restartrequested || ((cfg.RestartRate>0) && (mtRand.below(cfg.RestartRate)<candidates)))
+	{
+		if( cfg.Verbosity > 1)
+		{
+			printf("Restart.\n");
+		}
+		restartrequested=false;
+		stats.restarts++;
+		switch(cfg.PrefixType) // Recompute prefix if not fixed
+		{
+			case 1: // Fixed prefix - no update: vectors remain the same after restart
+				break;
+			case 2: // Greedy algorithm A 
+				fillprefixGreedyA(prefix, cfg.GreedyPrefixSize);
+				prepareTestVectorsFromPrefix(prefix);
+				break;
+			case 3: // Hybrid prefix
+				fillprefixFixedThenGreedyA(prefix, cfg.GreedyPrefixSize);
+				prepareTestVectorsFromPrefix(prefix);
+				break;
+			case 4: // Beam search
+				fillprefixBeam(prefix, cfg.GreedyPrefixSize);
+				prepareTestVectorsFromPrefix(prefix);
+				break;
+			default: // No prefix - no update: vectors remain the same after restart
+				break;
+		}
+		startNetwork();
+	}
+}
+
+SearchContext::SearchContext(const SearchConfig_t &config, uint64_t seed, SearchArchive_t *sharedarchive, const SearchContext *origin, u32 stream) : cfg(config)
+{
+	archive=sharedarchive;
+	ownarchive=NULL;
+	if(!archive)
+	{
+		ownarchive=new SearchArchive_t;
+		archive=ownarchive;
+	}
+	candidates=cfg.BatchSize*std::max(cfg.SpeculativeThreads,1u);
+	sharevectors=(cfg.Threads>1) || (cfg.SpeculativeThreads>1);
+	t0=clock();
+	t1=t0;
+	mtRand.seed(seed);
+	for(u32 k=0;k<stream;k++)
+	{
+		mtRand.longJump();
+	}
+	
+	/* Pick the widest test kernel supported by this CPU (or as requested) */
+	setupTester();
+	if((cfg.Verbosity > 1) && !origin)
+	{
+		printf("Test kernel word size: %u bit\n",tester.testKernelLanes()*PARWORDSIZE);
+	}
+	
+	/* Initialize set of CEs to pick from */
+	initalphabet();
+	initMutationSelector();
+	
+	if(origin)
+	{
+		followTestVectors(*origin);
+	}
+	else
+	{
+		/* Create initial prefix network */
+		switch(cfg.PrefixType)
+		{
+			case 1: // Fixed prefix
+				prefix=copyValidPairs(cfg.FixedPrefix, cfg.N);
+				break;
+			case 2: // Greedy algorithm A 
+				fillprefixGreedyA(prefix, cfg.GreedyPrefixSize);
+				break;
+			case 3: // Hybrid prefix
+				fillprefixFixedThenGreedyA(prefix, cfg.GreedyPrefixSize);
+				break;
+			case 4: // Beam search
+				fillprefixBeam(prefix, cfg.GreedyPrefixSize);
+				break;
+			default: // No prefix
+				prefix.clear();
+				break;
+		}
+		
+		if(cfg.Verbosity > 0)
+		{
+			printf("Prefix size: %lu\n",prefix.size());
+		}
+		
+		/* Prepare a set of test vectors matching the prefix */
+		prepareTestVectorsFromPrefix(prefix);
+	}
+	
+	if(cfg.SpeculativeThreads>1)
+	{
+		speculation=new Speculation_t;
+		speculation->results.resize(cfg.SpeculativeThreads);
+		RandGen_t workerstream=mtRand;
+		for(u32 w=0;w<cfg.SpeculativeThreads;w++)
+		{
+			workerstream.jump(); // Worker streams follow from the stream of the lineage, without drawing from it
+			speculation->workers.push_back(new SearchContext(*this, workerstream));
+			speculation->threads.push_back(std::thread(&SearchContext::speculationWorker, speculation->workers[w], speculation, w));
+		}
+	}
+	
+	startNetwork();
+}
+
+/**
+ * Set up a speculation worker of a lineage: same settings and tester configuration, the prefix and test vectors
+ * are taken from the lineage in each round
+ * @param lineage Search of the lineage
+ * @param rng Random generator of the worker
+ */
+SearchContext::SearchContext(const SearchContext &lineage, const RandGen_t &rng) : cfg(lineage.cfg), mtRand(rng)
+{
+	archive=lineage.archive;
+	ownarchive=NULL;
+	candidates=cfg.BatchSize;
+	sharevectors=lineage.sharevectors;
+	t0=clock();
+	t1=t0;
+	setupTester();
+	alphabet=lineage.alphabet;
+	mutationSelector=lineage.mutationSelector;
+}
+
+SearchContext::~SearchContext()
+{
+	if(speculation)
+	{
+		{
+			std::lock_guard<std::mutex> guard(speculation->lock);
+			speculation->stop=true;
+		}
+		speculation->wake.notify_all();
+		for(size_t w=0;w<speculation->threads.size();w++)
+		{
+			speculation->threads[w].join();
+			delete speculation->workers[w];
+		}
+		delete speculation;
+	}
+	delete ownarchive;
+}
+
+/**
+ * Fill the helper table that picks a mutation type with the requested probabilities
+ */
+void SearchContext::initMutationSelector()
+{
+	mutationSelector.clear();
+	for(u32 n=0;n<NMUTATIONTYPES;n++)
+	{
+		for(u32 k=0;k<cfg.mutation_type_weights[n];k++)
+			mutationSelector.push_back(n);
+	}
+}
+
+const SearchConfig_t &SearchContext::config() const
+{
+	return cfg;
+}
+
+bool SearchContext::retune(const SearchConfig_t &config)
+{
+	u32 totalweight=0;
+	for(u32 n=0;n<NMUTATIONTYPES;n++)
+	{
+		totalweight+=config.mutation_type_weights[n];
+	}
+	if(totalweight==0)
+		return false;
+	
+	cfg.EscapeRate=config.EscapeRate;
+	cfg.MaxMutations=config.MaxMutations;
+	for(u32 n=0;n<NMUTATIONTYPES;n++)
+	{
+		cfg.mutation_type_weights[n]=config.mutation_type_weights[n];
+	}
+	initMutationSelector();
+	tuningversion++;
+	return true;
+}
+
+void SearchContext::requestRestart()
+{
+	restartrequested=true;
+}
+
+SearchStats_t SearchContext::statistics() const
+{
+	Network_t expanded, totalnw;
+	SearchStats_t s=stats;
+	expandNetwork(pairs, expanded);
+	concatNetwork(prefix, expanded, totalnw);
+	s.prefixsize=prefix.size();
+	s.networksize=totalnw.size();
+	s.depth=computeDepth(totalnw);
+	return s;
+}
+
+void SearchContext::step(uint64_t n)
+{
+	for(uint64_t done=0;done<n;done+=candidates)
+	{
+		iterate();
+	}
+}
+
+const Network_t &SearchContext::network() const
+{
+	return pairs;
+}
@@ -0,0 +1,293 @@
+/**
+ * @file search_context.h
+ * @brief Reentrant evolutionary search for sorting networks, used by the SorterHunter program
+ * @author Bert Dobbelaere bert.o.dobbelaere[at]telenet[dot]be
+ *
+ * Copyright (c) 2022 Bert Dobbelaere
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _SEARCH_CONTEXT_H_
+#define _SEARCH_CONTEXT_H_
+
+#include "htypes.h"
+#include "hutils.h"
+#include "bp_tester.h"
+#include "ConfigParser.h"
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <functional>
+
+#define VERSION "SorterHunter_V0.4"
+
+#define NMUTATIONTYPES 6 ///< Number of different mutation types
+
+/**
+ * Settings of a search, see sample_config.txt for their meaning
+ */
+struct SearchConfig_t {
+	u8 N=0;                       ///< Problem dimension, i.e. number of inputs to be sorted
+	bool use_symmetry=true;       ///< Treat sorting network as symmetric or not
+	bool force_valid_uphill_step=true; ///< "Uphill" step inserts duplicate CE if not in final layer.
+	u32 EscapeRate=0;             ///< Adds a random pair (and its symmetric complement for symmetric networks) every x iterations
+	u32 MaxMutations=1;           ///< Maximum allowed number of mutations in evolution step
+	u32 mutation_type_weights[NMUTATIONTYPES]={1,1,1,1,1,1}; ///< Relative probabilities for each mutation type
+	u32 PrefixType=0;             ///< Type of prefix used (0=none, 1=fixed, 2=greedy, 3=hybrid, 4=beam search)
+	Network_t FixedPrefix;        ///< Fixed prefix to use (if applicable)
+	Network_t InitialNetwork;     ///< Initial starting point of network
+	u32 GreedyPrefixSize=0;       ///< Size of greedy prefix (if applicable)
+	u32 BeamWidth=8;              ///< Number of partial prefixes kept by the beam search prefix (PrefixType 4)
+	u32 BeamDepth=0;              ///< Number of steps the beam search looks ahead before committing to a step, 0=whole prefix at once
+	Network_t postfix;            ///< Fixed or empty postfix network
+	uint64_t RandomSeed=0;        ///< Random seed (0=nondeterministic)
+	uint64_t RestartRate=0;       ///< Return to initial conditions each ... iterations (0=never)
+	u32 Verbosity=1;              ///< Overall verbosity level: 0:minimal, 1:moderate, 2:high, >2:debug
+	u32 ParallelWordBits=0;       ///< Test kernel word size in bits (0=widest supported by CPU, 64, 256 or 512)
+	u32 CheckpointInterval=0;     ///< Number of CEs between checkpoints of the line states (0=no checkpoints)
+	u32 CheckpointGroups=1;       ///< Number of leading test vector groups covered by checkpoints
+	u32 BatchSize=1;              ///< Number of mutated candidates generated and tested together in each iteration
+	u32 PatternMajorThreshold=64; ///< Maximum number of test vectors for which the pattern-major test kernel is used
+	bool LayeredSearch=false;     ///< Mutate and test the core network as a list of layers
+	bool TernaryTest=false;       ///< Test candidates with ternary vectors covering all prefix outputs
+	bool TwoStageTest=false;      ///< Test candidates on a sample of the prefix outputs first, then on all of them
+	u32 SampleVectors=0;          ///< Number of prefix outputs in the sample (TwoStageTest, 0=four kernel words)
+	uint64_t SampleRefreshRate=100000; ///< Inverse probability per candidate to draw a new sample (TwoStageTest, 0=never)
+	u32 ChunkVectors=65536;       ///< Number of prefix outputs enumerated at once in the second stage (TwoStageTest)
+	u32 FailureCacheVectors=0;    ///< Maximum number of failing binary vectors kept when TernaryTest or TwoStageTest is used (0=one kernel word)
+	bool PruneInactive=true;      ///< Remove CEs of the accepted network that never swap on the test vectors
+	uint64_t MaxTestVectors=0;    ///< Use the ternary test when the prefix leaves more output patterns (0=no limit)
+	bool VerifyBDD=false;         ///< Verify reported networks with BDDs
+	u32 BDDMaxNodes=1u<<22;       ///< Node limit of the BDD verifier
+	u32 Threads=1;                ///< Number of searches (islands) that share the test vectors of the initial prefix
+	uint64_t MigrationInterval=1000000; ///< Number of candidates per island between migrations (0=no migration)
+	u32 SpeculativeThreads=1;     ///< Number of worker threads testing mutants of the network of each search (1=tested by the search itself)
+	bool ThreadAffinity=false;    ///< Pin threads to CPUs and keep a copy of shared test vectors per NUMA node
+	std::string ControlSocket;    ///< Path of the UNIX-domain control socket, empty if none
+};
+
+/**
+ * Read the settings of a search from a config file, and check them
+ * @param cp Parsed config file
+ * @param cfg [OUT] Settings
+ * @return true if the settings can be used
+ */
+bool readSearchConfig(const ConfigParser &cp, SearchConfig_t &cfg);
+
+extern const char *const mutationWeightKeys[NMUTATIONTYPES]; ///< Config keys of mutation_type_weights
+
+/**
+ * Read the settings that can be changed while a search runs (see SearchContext::retune): EscapeRate, MaxMutations and the mutation
+ * weights. Settings that are not given keep their value.
+ * @param cp Parsed settings
+ * @param cfg [IN/OUT] Settings
+ * @return false if no mutation type would be selected, cfg is not changed then
+ */
+bool readSearchTuning(const ConfigParser &cp, SearchConfig_t &cfg);
+
+/**
+ * Best performing (size,depth) combinations found by one or more searches. Searches running in different threads may share an archive.
+ */
+struct SearchArchive_t {
+	std::mutex lock;  ///< Protects conv_hull and the reports of improved networks
+	OCH_t conv_hull;  ///< "Best performing" network list found so far
+	std::function<void(const Network_t &nw, u32 depth, size_t prefixsize)> report; ///< If set, called with every improved network (prefix included) instead of printing it
+};
+
+/**
+ * Print the report of an improved network, followed by the list of best performing (size,depth) combinations
+ * @param cfg Settings of the search that found the network
+ * @param nw Network, prefix included
+ * @param depth Depth of the network
+ * @param prefixsize Size of the prefix
+ * @param conv_hull Best performing combinations
+ */
+void printNetworkReport(const SearchConfig_t &cfg, const Network_t &nw, u32 depth, size_t prefixsize, const OCH_t &conv_hull);
+
+/**
+ * Counters of a search
+ */
+struct SearchStats_t {
+	uint64_t candidates=0;  ///< Number of candidates generated
+	uint64_t accepted=0;    ///< Number of accepted candidates
+	uint64_t restarts=0;    ///< Number of restarts
+	size_t prefixsize=0;    ///< Size of the prefix
+	size_t networksize=0;   ///< Size of the current network, prefix and postfix included
+	u32 depth=0;            ///< Depth of the current network
+};
+
+struct Speculation_t;
+struct SharedTestVectors_t;
+
+/**
+ * Evolutionary search for sorting networks: prefix, test vectors and the evolving core network, with all the state needed to continue
+ * the search. Searches are independent of each other, unless they share an archive or test vectors, so several of them can be run
+ * in one process. A search is not meant to be used by several threads at once, its speculation workers (SpeculativeThreads>1) are
+ * managed by the search itself.
+ */
+class SearchContext
+{
+	public:
+		/**
+		 * Set up a search: select the test kernel, create the prefix and its test vectors, and find an initial network
+		 * @param config Settings of the search
+		 * @param seed Random seed of the search
+		 * @param sharedarchive Archive of best performing networks shared with other searches, NULL to use an archive of its own
+		 * @param origin Search with the same settings, whose prefix and test vectors are used instead of creating new ones.
+		 *               The full list of test vectors is shared if origin has Threads>1 or SpeculativeThreads>1. NULL if none.
+		 * @param stream Index of the random stream: searches with the same seed and different streams draw non-overlapping sequences
+		 * With ThreadAffinity, the speculation workers pin themselves to CPUs. The thread that runs the search is expected to be
+		 * pinned by the caller (see pinThreadToNextCpu) before the search is set up, as memory is placed on the node that first uses it.
+		 */
+		SearchContext(const SearchConfig_t &config, uint64_t seed, SearchArchive_t *sharedarchive=NULL, const SearchContext *origin=NULL, u32 stream=0);
+		
+		/**
+		 * Continue the search. Improved networks are reported on stdout as they are found.
+		 * @param n Number of candidates to generate and test, rounded up to a whole number of iterations
+		 */
+		void step(uint64_t n);
+		
+		/**
+		 * Current core network: evolving section between prefix and postfix, without mirrored pairs for symmetric networks
+		 * @return Core network
+		 */
+		const Network_t &network() const;
+		
+		/**
+		 * Offer a core network found by another search (island model migration). The network is adopted if it is smaller than the
+		 * current core network, and forms a valid sorter with the prefix of this search.
+		 * @param nw Core network
+		 * @return true if the network was adopted
+		 */
+		bool offerNetwork(const Network_t &nw);
+		
+		/**
+		 * Make a core network the current one if it forms a valid sorter with the prefix of this search, whatever its size.
+		 * Pairs out of range are removed, as for InitialNetwork.
+		 * @param nw Core network
+		 * @return true if the network was adopted
+		 */
+		bool injectNetwork(const Network_t &nw);
+		
+		/**
+		 * Current settings of the search
+		 * @return Settings
+		 */
+		const SearchConfig_t &config() const;
+		
+		/**
+		 * Change the settings that steer the mutations while the search runs: EscapeRate, MaxMutations and mutation_type_weights.
+		 * Other settings are ignored.
+		 * @param config Settings to take them from
+		 * @return false if no mutation type is selected, nothing is changed then
+		 */
+		bool retune(const SearchConfig_t &config);
+		
+		/**
+		 * Restart the search in the next iteration, as if RestartRate triggered it
+		 */
+		void requestRestart();
+		
+		/**
+		 * Counters of the search and size of the current network
+		 * @return Counters
+		 */
+		SearchStats_t statistics() const;
+		
+		/**
+		 * Clean up, stops the speculation workers
+		 */
+		~SearchContext();
+	private:
+		SearchContext(const SearchContext &lineage, const RandGen_t &rng);
+		SearchContext(const SearchContext &);            ///< Not copyable
+		SearchContext &operator=(const SearchContext &); ///< Not copyable
+		
+		void setupTester();
+		void refreshSample();
+		void maybeRefreshSample(u32 ncandidates);
+		void useSharedTestVectors(const std::shared_ptr<SharedTestVectors_t> &shared);
+		void prepareTestVectorsFromPrefix(const Network_t &prefix);
+		void followTestVectors(const SearchContext &source);
+		void expandNetwork(const Network_t &core, Network_t &nw) const;
+		size_t mirroredSize(const Network_t &core) const;
+		size_t expandedSize(const Network_t &core) const;
+		size_t expandedSize(const LayeredNetwork_t &nl) const;
+		void initalphabet();
+		void initMutationSelector();
+		void fillprefixGreedyA(Network_t &prefix, u32 npairs);
+		void fillprefixFixedThenGreedyA(Network_t &prefix, u32 npairs);
+		void fillprefixBeam(Network_t &prefix, u32 npairs);
+		u32 attemptMutation(Network_t &newpairs, bool unmodified);
+		void removeLayerCE(LayeredNetwork_t &nl, u32 l, u32 k) const;
+		u32 attemptLayerMutation(LayeredNetwork_t &nl);
+		void createBatch();
+		size_t candidateSize(u32 m) const;
+		int selectCandidate(size_t &bestsize) const;
+		void pruneInactive();
+		void checkImproved(const Network_t &nw);
+		void acceptNetwork();
+		void speculationWorker(Speculation_t *sp, u32 worker);
+		bool speculate();
+		void startNetwork();
+		void iterate();
+		
+		SearchConfig_t cfg;           ///< Settings of the search
+		BPTester tester;              ///< Tester of candidate networks
+		SearchArchive_t *archive;     ///< Archive of best performing networks
+		SearchArchive_t *ownarchive;  ///< Archive owned by this search, NULL if shared
+		u32 candidates;               ///< Number of candidates per iteration
+		bool sharevectors;            ///< Full lists of test vectors are prepared to be shared
+		
+		Network_t alphabet;                ///< Set of all possible pairs, unique taking into account symmetric complements
+		std::vector<u8> mutationSelector;  ///< Helper variable to quickly pick a mutation with the requested probability.
+		RandGen_t mtRand;                  ///< Fast generator with jump-ahead streams, see RandGen_t. This is no crypto application.
+		
+		Network_t pairs;                          ///< Current core network: evolving section between prefix and postfix. For symmetric networks, mirrored pair (if not coinciding) is omitted.
+		Network_t se;                             ///< Symmetrical expansion of current network
+		std::vector<Network_t> batchpairs;        ///< Candidate core networks of the current iteration
+		LayeredNetwork_t layers;                  ///< Current core network split in layers (LayeredSearch only)
+		std::vector<LayeredNetwork_t> batchlayers; ///< Candidate layered core networks of the current iteration (LayeredSearch only)
+		std::vector<bool> batchvalid;             ///< Test results of the candidate networks
+		std::vector<uint64_t> activity;           ///< Number of test vectors on which each CE of the current core network swaps, empty if not known
+		size_t prunelevel=0;                      ///< Smallest core network size since the last restart, larger networks are not pruned
+		Network_t prefix;                         ///< Fixed, greedy, hybrid or empty prefix network
+		bool ternaryfallback=false;               ///< The prefix leaves more than MaxTestVectors output patterns, the ternary test is used
+		
+		BitParallelList_t parallelpatterns_from_prefix;         ///< Test vectors fed to the tester, only the private part if they are shared
+		std::vector<SinglePatternList_t> prefixclusters;        ///< Output pattern lists of the line clusters left by the prefix (TernaryTest, TwoStageTest or MaxTestVectors only)
+		std::shared_ptr<SharedTestVectors_t> sourcepatterns;    ///< Full list of test vectors if it is shared, NULL otherwise
+		uint64_t testvectorversion=0;                           ///< Incremented whenever new test vectors are prepared
+		
+		Speculation_t *speculation=NULL; ///< Speculation workers (SpeculativeThreads>1), NULL if none
+		uint64_t tuningversion=0;        ///< Incremented whenever the mutation settings are changed, followed by the speculation workers
+		bool restartrequested=false;     ///< Restart in the next iteration
+		SearchStats_t stats;             ///< Counters of the search
+		
+		uint64_t itercount=0;        ///< Number of candidates tested (Verbosity>2)
+		uint64_t iter_next_report=1; ///< Candidate count of the next progress report
+		uint64_t iter_last_report=0; ///< Candidate count of the last progress report
+		clock_t t0;                  ///< Start time of the search
+		clock_t t1;                  ///< Time of the last progress report
+};
+
+#endif // _SEARCH_CONTEXT_H_
@@ -0,0 +1,206 @@
+/**
+ * @file thread_affinity.cpp
+ * @brief Pinning of search threads to CPUs, spread over the NUMA nodes
+ * @author Bert Dobbelaere bert.o.dobbelaere[at]telenet[dot]be
+ *
+ * Copyright (c) 2022 Bert Dobbelaere
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "thread_affinity.h"
+
+#include <stdio.h>
+#include <vector>
+#include <atomic>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+/**
+ * CPUs available to the process and their NUMA nodes, read once from sysfs
+ */
+struct CpuTopology_t {
+	std::vector<u32> order; ///< CPUs available to the process, taken round robin over the nodes
+	std::vector<int> node;  ///< NUMA node of each CPU number, -1 if unknown
+	u32 nodes=1;            ///< Number of NUMA nodes
+	std::atomic<u32> next{0}; ///< Index in order of the next CPU to assign
+	
+	CpuTopology_t();
+};
+
+#ifdef __linux__
+/**
+ * Parse a CPU list from sysfs, like "0-15,32-47"
+ * @param s CPU list
+ * @param cpus [OUT] CPU numbers
+ */
+static void parseCpuList(const char *s, std::vector<u32> &cpus)
+{
+	while(*s)
+	{
+		unsigned first, last;
+		int len=0;
+		if(sscanf(s, "%u%n", &first, &len)!=1)
+			break;
+		s+=len;
+		last=first;
+		if(*s=='-')
+		{
+			if(sscanf(s+1, "%u%n", &last, &len)!=1)
+				break;
+			s+=1+len;
+		}
+		for(u32 c=first;c<=last;c++)
+			cpus.push_back(c);
+		if(*s!=',')
+			break;
+		s++;
+	}
+}
+
+/**
+ * Read the CPUs available to the process and their NUMA nodes
+ * @param topo [OUT] Topology
+ */
+static void readTopology(CpuTopology_t &topo)
+{
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if(sched_getaffinity(0, sizeof(allowed), &allowed)!=0)
+		return;
+	topo.node.assign(CPU_SETSIZE, -1);
+	
+	/* Nodes are numbered densely in practice, stop at the first missing one */
+	std::vector<std::vector<u32> > nodecpus;
+	for(u32 n=0;;n++)
+	{
+		char path[80];
+		char line[4096];
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", n);
+		FILE *f=fopen(path, "r");
+		if(!f)
+			break;
+		std::vector<u32> cpus, usable;
+		if(fgets(line, sizeof(line), f))
+			parseCpuList(line, cpus);
+		fclose(f);
+		for(size_t k=0;k<cpus.size();k++)
+		{
+			if((cpus[k]<CPU_SETSIZE) && CPU_ISSET(cpus[k], &allowed))
+			{
+				topo.node[cpus[k]]=n;
+				usable.push_back(cpus[k]);
+			}
+		}
+		nodecpus.push_back(usable);
+	}
+	
+	if(nodecpus.empty())
+	{
+		/* No NUMA information: a single node holding all available CPUs */
+		nodecpus.resize(1);
+		for(u32 c=0;c<CPU_SETSIZE;c++)
+		{
+			if(CPU_ISSET(c, &allowed))
+			{
+				topo.node[c]=0;
+				nodecpus[0].push_back(c);
+			}
+		}
+	}
+	topo.nodes=nodecpus.size();
+	
+	for(size_t k=0;;k++)
+	{
+		bool any=false;
+		for(size_t n=0;n<nodecpus.size();n++)
+		{
+			if(k<nodecpus[n].size())
+			{
+				topo.order.push_back(nodecpus[n][k]);
+				any=true;
+			}
+		}
+		if(!any)
+			break;
+	}
+}
+#endif
+
+CpuTopology_t::CpuTopology_t()
+{
+#ifdef __linux__
+	readTopology(*this);
+#endif
+}
+
+/**
+ * Topology of the system, read on first use
+ * @return Topology
+ */
+static CpuTopology_t &topology()
+{
+	static CpuTopology_t topo;
+	return topo;
+}
+
+int pinThreadToNextCpu()
+{
+#ifdef __linux__
+	CpuTopology_t &topo=topology();
+	if(topo.order.empty())
+		return -1;
+	u32 cpu=topo.order[topo.next++ % topo.order.size()];
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if(sched_setaffinity(0, sizeof(set), &set)!=0)
+		return -1;
+	return topo.node[cpu];
+#else
+	return -1;
+#endif
+}
+
+void setNextCpu(u32 slot)
+{
+	topology().next=slot;
+}
+
+int currentNumaNode()
+{
+#ifdef __linux__
+	CpuTopology_t &topo=topology();
+	int cpu=sched_getcpu();
+	if((cpu<0) || ((size_t)cpu>=topo.node.size()))
+		return -1;
+	return topo.node[cpu];
+#else
+	return -1;
+#endif
+}
+
+u32 numaNodeCount()
+{
+	return topology().nodes;
+}
@@ -0,0 +1,59 @@
+/**
+ * @file thread_affinity.h
+ * @brief Pinning of search threads to CPUs, spread over the NUMA nodes
+ * @author Bert Dobbelaere bert.o.dobbelaere[at]telenet[dot]be
+ *
+ * Copyright (c) 2022 Bert Dobbelaere
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _THREAD_AFFINITY_H_
+#define _THREAD_AFFINITY_H_
+
+#include "htypes.h"
+
+/**
+ * Pin the calling thread to the next CPU of the process, taking the CPUs round robin over the NUMA nodes so that consecutive
+ * threads are spread over the nodes. When all CPUs are taken, the assignment wraps around.
+ * @return NUMA node of the CPU, -1 if threads can not be pinned on this system
+ */
+int pinThreadToNextCpu();
+
+/**
+ * Select the CPU taken by the next call of pinThreadToNextCpu, e.g. to give processes that share the CPUs disjoint sets
+ * @param slot Index of the CPU in the order of pinThreadToNextCpu
+ */
+void setNextCpu(u32 slot);
+
+/**
+ * NUMA node of the CPU the calling thread runs on. Only stable for threads that are pinned.
+ * @return NUMA node, -1 if unknown
+ */
+int currentNumaNode();
+
+/**
+ * Number of NUMA nodes of the system
+ * @return Number of nodes, 1 if not known
+ */
+u32 numaNodeCount();
+
+#endif // _THREAD_AFFINITY_H_